@@ -0,0 +1,200 @@
+#!/bin/bash
+
+# Scaling benchmark of main
+#
+# Runs main with --profile over every size, rank count and set of flags on
+# a --synthetic image with a --checksum instead of an output file, so no
+# run touches the disk. Keeps the fastest of the repeats and writes one CSV
+# row per run:
+#
+#   mode,size,ranks,threads,iterations,seconds_per_iteration,comm_fraction,efficiency,flags
+#
+# seconds_per_iteration is the mean over the ranks of the time spent in the
+# iteration loop (pack, wait, compute and balance), comm_fraction the part of
+# it spent packing and waiting for halos. efficiency compares to the smallest
+# rank count with the same size and flags: n0 * t0 / (n * t) for strong
+# scaling, t0 / t for weak scaling, where every rank keeps a tile of the
+# given size and the image grows in height.
+
+help () {
+    echo "Scaling benchmark of main"
+    echo ""
+    echo "  -s <sizes>       image sizes, per rank with -w (\"$SIZES\")"
+    echo "  -n <ranks>       rank counts (\"$RANKS\")"
+    echo "  -f <flags>       sets of flags separated by ';' (\"$FLAGS\")"
+    echo "  -i <iterations>  iterations per run ($ITERATIONS)"
+    echo "  -r <repeats>     runs of which the fastest is kept ($REPEATS)"
+    echo "  -t <threads>     OpenMP threads per rank ($THREADS)"
+    echo "  -w               weak scaling instead of strong scaling"
+    echo "  -o <file>        output CSV ($OUTPUT)"
+    echo "  -b <file>        baseline CSV to compare with"
+    echo "  -h               show this help page"
+    echo ""
+    echo "MPIRUN is the launcher, \"$MPIRUN\" by default."
+    echo ""
+    echo "e.g. bench.sh -s \"2048x2048\" -n \"1 2 4\" -o new.csv -b old.csv"
+}
+
+DIR=$(dirname "$0")
+BIN=${DIR}/../main
+MPIRUN=${MPIRUN:-mpirun}
+
+SIZES="1024x1024 2048x2048"
+RANKS="1 2 4"
+FLAGS="-g;-g -T 4;-g -z"
+ITERATIONS=20
+REPEATS=3
+THREADS=1
+MODE=strong
+OUTPUT=${DIR}/results.csv
+BASELINE=""
+
+while getopts "s:n:f:i:r:t:wo:b:h" C; do
+    case $C in
+    s) SIZES=$OPTARG ;;
+    n) RANKS=$OPTARG ;;
+    f) FLAGS=$OPTARG ;;
+    i) ITERATIONS=$OPTARG ;;
+    r) REPEATS=$OPTARG ;;
+    t) THREADS=$OPTARG ;;
+    w) MODE=weak ;;
+    o) OUTPUT=$OPTARG ;;
+    b) BASELINE=$OPTARG ;;
+    h)
+        help
+        exit 0
+        ;;
+    *)
+        help >&2
+        exit 1
+        ;;
+    esac
+done
+
+[ ! -x "$BIN" ] && {
+    echo "Could not find executable $BIN, run 'make bench'!" >&2
+    exit 1
+}
+[ -n "$BASELINE" ] && [ ! -f "$BASELINE" ] && {
+    echo "Could not read baseline '$BASELINE'!" >&2
+    exit 1
+}
+
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+
+# Mean seconds of the loop phases in the --profile report, as
+# <loop>,<communication>
+function loopTime() {
+    awk '
+        $1 == "pack" || $1 == "wait" { comm += $3 }
+        $1 == "pack" || $1 == "wait" || $1 == "compute" || $1 == "balance" { loop += $3 }
+        END { printf "%.9f,%.9f\n", loop, comm }
+    ' "$1"
+}
+
+RUNS=$TMP/runs
+: > $RUNS
+IFS=';' read -r -a FLAGSETS <<< "$FLAGS"
+for SIZE in $SIZES; do
+    W=${SIZE%x*}
+    H=${SIZE#*x}
+    for N in $RANKS; do
+        [ $MODE = weak ] && IMAGE=${W}x$(( H * N )) || IMAGE=$SIZE
+        for F in "${FLAGSETS[@]}"; do
+            BEST=""
+            for R in $(seq $REPEATS); do
+                RUN="$MPIRUN -np $N $BIN --synthetic $IMAGE --checksum -i $ITERATIONS -t $THREADS -p $F"
+                $RUN > $TMP/report 2>&1 || {
+                    echo "Failed: $RUN" >&2
+                    cat $TMP/report >&2
+                    exit 1
+                }
+                TIMES=$(loopTime $TMP/report)
+                BEST=$(echo "$TIMES,$BEST" | awk -F, -v OFS=, 'NF == 3 || $1 < $3 { print $1, $2; next } { print $3, $4 }')
+            done
+            echo "$MODE,$SIZE,$N,$THREADS,$ITERATIONS,$BEST,$F" >> $RUNS
+            echo "$BEST" | awk -F, -v line="$MODE $SIZE $N $ITERATIONS" -v flags="$F" '{
+                split(line, run, " ")
+                printf "%-6s %-11s %3d ranks  %.6f s/iteration  %5.1f%% comm  %s\n",
+                    run[1], run[2], run[3], $1 / run[4], ($1 > 0) ? 100 * $2 / $1 : 0, flags
+            }' >&2
+        done
+    done
+done
+
+# Efficiency against the smallest rank count of the same size and flags
+awk -F, -v OFS=, '
+    {
+        flags = $8
+        for (i = 9; i <= NF; i++) {
+            flags = flags "," $i
+        }
+        key = $2 "," $4 "," $5 "," flags
+        row[NR] = $1 "," $2 "," $3 "," $4 "," $5
+        keys[NR] = key
+        set[NR] = flags
+        mode[NR] = $1
+        ranks[NR] = $3
+        time[NR] = $6 / $5
+        comm[NR] = ($6 > 0) ? $7 / $6 : 0
+        if (!(key in base) || $3 < baseRanks[key]) {
+            base[key] = time[NR]
+            baseRanks[key] = $3
+        }
+    }
+    END {
+        print "mode,size,ranks,threads,iterations,seconds_per_iteration,comm_fraction,efficiency,flags"
+        for (i = 1; i <= NR; i++) {
+            key = keys[i]
+            if (mode[i] == "weak") {
+                efficiency = base[key] / time[i]
+            } else {
+                efficiency = baseRanks[key] * base[key] / (ranks[i] * time[i])
+            }
+            printf "%s,%.9f,%.4f,%.4f,%s\n", row[i], time[i], comm[i], efficiency, set[i]
+        }
+    }
+' $RUNS > "$OUTPUT"
+echo "Wrote $OUTPUT" >&2
+
+# Current against baseline for the runs in both. The flags are the last
+# column and may contain commas.
+function summary() {
+    awk -F, '
+        function rowKey() {
+            flags = $9
+            for (i = 10; i <= NF; i++) {
+                flags = flags "," $i
+            }
+            return $1 "," $2 "," $3 "," $4 "," flags
+        }
+        FNR == 1 { next }
+        FILENAME == ARGV[1] {
+            baseline[rowKey()] = $6
+            next
+        }
+        {
+            key = rowKey()
+            if (!header) {
+                printf "%-6s %-11s %5s %12s %12s %8s %6s %6s  %s\n",
+                    "mode", "size", "ranks", "baseline", "current", "speedup", "comm", "eff", "flags"
+                header = 1
+            }
+            if (key in baseline) {
+                printf "%-6s %-11s %5d %12.6f %12.6f %7.2fx %5.1f%% %6.2f  %s\n",
+                    $1, $2, $3, baseline[key], $6, baseline[key] / $6, 100 * $7, $8, flags
+            } else {
+                printf "%-6s %-11s %5d %12s %12.6f %8s %5.1f%% %6.2f  %s\n",
+                    $1, $2, $3, "-", $6, "-", 100 * $7, $8, flags
+            }
+        }
+    ' "$1" "$2"
+}
+
+if [ -n "$BASELINE" ]; then
+    summary "$BASELINE" "$OUTPUT"
+else
+    summary /dev/null "$OUTPUT"
+fi
+exit 0
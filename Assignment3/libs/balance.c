@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include "balance.h"
+#include "grid.h"
+
+// Part of the image owned by a rank
+typedef struct {
+  int x0;
+  int x1;
+  int y0;
+  int y1;
+} rankRect;
+
+static rankRect rectOfRank(int const *rowSplit, int const *colSplit, int gridWidth, int rank) {
+  int row = rank / gridWidth;
+  int col = rank % gridWidth;
+  rankRect rect;
+  rect.x0 = calcOffset(colSplit, col);
+  rect.x1 = rect.x0 + colSplit[col];
+  rect.y0 = calcOffset(rowSplit, row);
+  rect.y1 = rect.y0 + rowSplit[row];
+  return rect;
+}
+
+static rankRect intersectRects(rankRect a, rankRect b) {
+  rankRect rect;
+  rect.x0 = (a.x0 > b.x0) ? a.x0 : b.x0;
+  rect.x1 = (a.x1 < b.x1) ? a.x1 : b.x1;
+  rect.y0 = (a.y0 > b.y0) ? a.y0 : b.y0;
+  rect.y1 = (a.y1 < b.y1) ? a.y1 : b.y1;
+  return rect;
+}
+
+// Split total cells over the parts, halfway between the current split and
+// shares inversely proportional to the cost of one cell of every part
+static void rebalanceSplit(int *split, int parts, double const *cost, int minCells) {
+  int total = 0;
+  double inverse = 0;
+  for (int i = 0; i < parts; i++) {
+    total += split[i];
+    inverse += 1.0 / cost[i];
+  }
+
+  double *share = malloc(parts * sizeof(double));
+  int assigned = 0;
+  for (int i = 0; i < parts; i++) {
+    share[i] = 0.5 * split[i] + 0.5 * total * (1.0 / cost[i]) / inverse;
+    split[i] = (int)share[i];
+    assigned += split[i];
+  }
+
+  // Hand out the cells lost by rounding to the largest remainders
+  while (assigned < total) {
+    int best = 0;
+    for (int i = 1; i < parts; i++) {
+      if (share[i] - split[i] > share[best] - split[best]) {
+        best = i;
+      }
+    }
+    split[best]++;
+    share[best] = split[best];
+    assigned++;
+  }
+
+  // Every part has to stay at least as large as the halo
+  for (int i = 0; i < parts; i++) {
+    while (split[i] < minCells) {
+      int largest = 0;
+      for (int j = 1; j < parts; j++) {
+        if (split[j] > split[largest]) {
+          largest = j;
+        }
+      }
+      if (split[largest] <= minCells) {
+        break;
+      }
+      split[largest]--;
+      split[i]++;
+    }
+  }
+  free(share);
+}
+
+// Update the split from the compute time of every rank. Returns 1 if the
+// split changed, 0 if the imbalance is below the threshold.
+int balanceSplits(
+  int *rowSplit,
+  int *colSplit,
+  int gridWidth,
+  int gridHeight,
+  double const *times,
+  int minCells,
+  double threshold
+) {
+  int ranks = gridWidth * gridHeight;
+  double max = 0;
+  double mean = 0;
+  for (int i = 0; i < ranks; i++) {
+    max = (times[i] > max) ? times[i] : max;
+    mean += times[i] / ranks;
+  }
+  if (mean <= 0 || max / mean < 1.0 + threshold) {
+    return 0;
+  }
+
+  // Cost of one row of pixels in a grid row is set by its slowest rank,
+  // likewise for the columns
+  double *rowCost = calloc(gridHeight, sizeof(double));
+  double *colCost = calloc(gridWidth, sizeof(double));
+  for (int r = 0; r < gridHeight; r++) {
+    for (int c = 0; c < gridWidth; c++) {
+      double time = times[r * gridWidth + c] + 1e-9;
+      double perRow = time / rowSplit[r];
+      double perCol = time / colSplit[c];
+      rowCost[r] = (perRow > rowCost[r]) ? perRow : rowCost[r];
+      colCost[c] = (perCol > colCost[c]) ? perCol : colCost[c];
+    }
+  }
+
+  int *oldRowSplit = malloc(gridHeight * sizeof(int));
+  int *oldColSplit = malloc(gridWidth * sizeof(int));
+  for (int r = 0; r < gridHeight; r++) {
+    oldRowSplit[r] = rowSplit[r];
+  }
+  for (int c = 0; c < gridWidth; c++) {
+    oldColSplit[c] = colSplit[c];
+  }
+  rebalanceSplit(rowSplit, gridHeight, rowCost, minCells);
+  rebalanceSplit(colSplit, gridWidth, colCost, minCells);
+
+  int changed = 0;
+  for (int r = 0; r < gridHeight; r++) {
+    changed |= (oldRowSplit[r] != rowSplit[r]);
+  }
+  for (int c = 0; c < gridWidth; c++) {
+    changed |= (oldColSplit[c] != colSplit[c]);
+  }
+
+  free(rowCost);
+  free(colCost);
+  free(oldRowSplit);
+  free(oldColSplit);
+  return changed;
+}
+
+// Datatype of a part of the image inside the frame of a tile
+static MPI_Datatype rectType(imageTile *tile, rankRect owned, rankRect part) {
+  int sizes[2] = {tile->height + 2 * tile->count, tile->stride};
+  int subsizes[2] = {part.y1 - part.y0, (part.x1 - part.x0) * tile->channels};
+  int starts[2] = {
+    part.y0 - owned.y0 + tile->count,
+    (part.x0 - owned.x0 + tile->count) * tile->channels
+  };
+  MPI_Datatype type;
+  MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_BYTE, &type);
+  MPI_Type_commit(&type);
+  return type;
+}
+
+// Move the data of a tile from the old split to the new split. Returns the
+// new tile, with the same halo depth. The halo has to be exchanged again.
+imageTile * migrateTile(
+  imageTile *tile,
+  int const *oldRowSplit,
+  int const *oldColSplit,
+  int const *rowSplit,
+  int const *colSplit,
+  int gridWidth,
+  int rank,
+  MPI_Comm comm
+) {
+  int ranks;
+  MPI_Comm_size(comm, &ranks);
+
+  rankRect oldRect = rectOfRank(oldRowSplit, oldColSplit, gridWidth, rank);
+  rankRect newRect = rectOfRank(rowSplit, colSplit, gridWidth, rank);
+  imageTile *moved = newImageTile(newRect.x1 - newRect.x0, newRect.y1 - newRect.y0, tile->count, tile->channels);
+
+  MPI_Request *requests = malloc(2 * ranks * sizeof(MPI_Request));
+  MPI_Datatype *types = malloc(2 * ranks * sizeof(MPI_Datatype));
+  int count = 0;
+
+  for (int other = 0; other < ranks; other++) {
+    // Part of the old tile the other rank owns from now on
+    rankRect send = intersectRects(oldRect, rectOfRank(rowSplit, colSplit, gridWidth, other));
+    if (send.x0 < send.x1 && send.y0 < send.y1) {
+      types[count] = rectType(tile, oldRect, send);
+      MPI_Isend(tile->rawdata, 1, types[count], other, 0, comm, &requests[count]);
+      count++;
+    }
+
+    // Part of the new tile the other rank owned until now
+    rankRect recv = intersectRects(newRect, rectOfRank(oldRowSplit, oldColSplit, gridWidth, other));
+    if (recv.x0 < recv.x1 && recv.y0 < recv.y1) {
+      types[count] = rectType(moved, newRect, recv);
+      MPI_Irecv(moved->rawdata, 1, types[count], other, 0, comm, &requests[count]);
+      count++;
+    }
+  }
+
+  MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+  for (int i = 0; i < count; i++) {
+    MPI_Type_free(&types[i]);
+  }
+  free(requests);
+  free(types);
+  return moved;
+}
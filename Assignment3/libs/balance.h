@@ -0,0 +1,37 @@
+#include <mpi.h>
+#include "tile.h"
+
+#ifndef BALANCE_H
+#define BALANCE_H
+
+// Load balancing of the 2-D tile decomposition
+//
+// Every rank measures the time it spends computing over a window of
+// iterations. From these times the row and column split of the grid are
+// moved towards shares inversely proportional to the measured cost of one
+// row or column of pixels, taking the slowest rank of a grid row or column
+// as its cost. Only the parts of the tiles that change owner are moved,
+// which for small shifts are strips between neighbours.
+
+int balanceSplits(
+  int *rowSplit,
+  int *colSplit,
+  int gridWidth,
+  int gridHeight,
+  double const *times,
+  int minCells,
+  double threshold
+);
+
+imageTile * migrateTile(
+  imageTile *tile,
+  int const *oldRowSplit,
+  int const *oldColSplit,
+  int const *rowSplit,
+  int const *colSplit,
+  int gridWidth,
+  int rank,
+  MPI_Comm comm
+);
+
+#endif
@@ -3,9 +3,6 @@
 #include <string.h>
 #include "bitmap.h"
 
-
-#define BMP_HEADER_SIZE 54
-
 void freeBmpData(bmpImage *image) {
   if (image->data != NULL) {
     free(image->data);
@@ -219,6 +216,27 @@ failed_file:
   return ret;
 }
 
+// Bytes of one row in the file, padded to a multiple of four
+unsigned int bmpLineSize(unsigned int width) {
+  return (width * sizeof(pixel) + 3) / 4 * 4;
+}
+
+void createBmpHeader(
+    unsigned char *header,
+    unsigned int const width,
+    unsigned int const height
+    ) {
+  const size_t size = width * height * sizeof(pixel) + BMP_HEADER_SIZE;
+
+  unsigned char const fields[BMP_HEADER_SIZE]= {
+    'B', 'M', size & 255, (size >> 8) & 255, (size >> 16) & 255, size >> 24, 0,
+    0, 0, 0, 54, 0, 0, 0, 40, 0, 0, 0, width & 255, width >> 8, 0,
+    0, height & 255, height >> 8, 0, 0, 1, 0, 24, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+  memcpy(header, fields, BMP_HEADER_SIZE);
+}
+
 int saveBmpImage(bmpImage *image, char const *filename) {
   int ret = 0;
   FILE *fImage=fopen(filename,"wb");
@@ -227,21 +245,11 @@ int saveBmpImage(bmpImage *image, char const *filename) {
   }
 
   char padBuffer[4] = {};
-  const size_t dataSize = image->width * image->height * sizeof(pixel);
   size_t lineWidth = image->width * sizeof(pixel);
-  size_t padding = 0;
-  if (lineWidth % 4 != 0) {
-    padding = 4 - (lineWidth % 4);
-  }
-
-  const size_t size= dataSize + BMP_HEADER_SIZE;
+  size_t padding = bmpLineSize(image->width) - lineWidth;
 
-  unsigned char header[BMP_HEADER_SIZE]= {
-    'B', 'M', size & 255, (size >> 8) & 255, (size >> 16) & 255, size >> 24, 0,
-    0, 0, 0, 54, 0, 0, 0, 40, 0, 0, 0, image->width & 255, image->width >> 8, 0,
-    0, image->height & 255, image->height >> 8, 0, 0, 1, 0, 24, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-  };
+  unsigned char header[BMP_HEADER_SIZE];
+  createBmpHeader(header, image->width, image->height);
 
   if (fwrite(header, sizeof(unsigned char), BMP_HEADER_SIZE,fImage) < BMP_HEADER_SIZE) {
     ret = 1;
@@ -1,6 +1,8 @@
 #ifndef BITMAP_H
 #define BITMAP_H
 
+#define BMP_HEADER_SIZE 54
+
 typedef struct {
   unsigned char b;
   unsigned char g;
@@ -26,6 +28,12 @@ void freeBmpImage(bmpImage *image);
 int loadBmpImage(bmpImage *image, char const *filename);
 int loadBmpImageSizeOnly(bmpImage *image, char const *filename);
 int saveBmpImage(bmpImage *image, char const *filename);
+unsigned int bmpLineSize(unsigned int width);
+void createBmpHeader(
+  unsigned char *header,
+  unsigned int const width,
+  unsigned int const height
+);
 
 bmpImageChannel * newBmpImageChannel(
   unsigned int const width,
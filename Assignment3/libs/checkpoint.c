@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "checkpoint.h"
+#include "grid.h"
+
+enum {
+  FIELD_MAGIC,
+  FIELD_VERSION,
+  FIELD_ITERATION,
+  FIELD_WIDTH,
+  FIELD_HEIGHT,
+  FIELD_CHANNELS,
+  FIELD_GRID_WIDTH,
+  FIELD_GRID_HEIGHT,
+  FIELDS
+};
+
+// Offset of the image after the fields and the splits
+static MPI_Offset imageOffset(int gridWidth, int gridHeight) {
+  MPI_Offset size = (FIELDS + gridWidth + gridHeight) * sizeof(int);
+  return (size + CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+}
+
+// File view of the tile at x0, y0 in the image, and the inside of its frame
+// in memory, so the tile is read and written without a copy
+static void tileTypes(
+  imageTile const *tile,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight,
+  MPI_Datatype *fileType,
+  MPI_Datatype *memoryType
+) {
+  int channels = tile->channels;
+  int fileSizes[2] = {imageHeight, imageWidth * channels};
+  int subsizes[2] = {tile->height, tile->width * channels};
+  int fileStarts[2] = {y0, x0 * channels};
+  MPI_Type_create_subarray(2, fileSizes, subsizes, fileStarts, MPI_ORDER_C, MPI_BYTE, fileType);
+  MPI_Type_commit(fileType);
+
+  int memorySizes[2] = {tile->height + 2 * tile->count, tile->stride};
+  int memoryStarts[2] = {tile->count, tile->count * channels};
+  MPI_Type_create_subarray(2, memorySizes, subsizes, memoryStarts, MPI_ORDER_C, MPI_BYTE, memoryType);
+  MPI_Type_commit(memoryType);
+}
+
+int writeCheckpoint(
+  char const *filename,
+  imageTile *tile,
+  int iteration,
+  int imageWidth,
+  int imageHeight,
+  int const *rowSplit,
+  int const *colSplit,
+  int gridWidth,
+  int gridHeight,
+  MPI_Comm comm
+) {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  char partname[1024];
+  snprintf(partname, sizeof(partname), "%s.part", filename);
+
+  MPI_File file;
+  if (MPI_File_open(comm, partname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    return 1;
+  }
+  MPI_Offset offset = imageOffset(gridWidth, gridHeight);
+  MPI_File_set_size(file, offset + (MPI_Offset)imageWidth * imageHeight * tile->channels);
+
+  int ret = 0;
+  if (rank == 0) {
+    int count = FIELDS + gridHeight + gridWidth;
+    int *header = calloc(count, sizeof(int));
+    header[FIELD_MAGIC] = CHECKPOINT_MAGIC;
+    header[FIELD_VERSION] = CHECKPOINT_VERSION;
+    header[FIELD_ITERATION] = iteration;
+    header[FIELD_WIDTH] = imageWidth;
+    header[FIELD_HEIGHT] = imageHeight;
+    header[FIELD_CHANNELS] = tile->channels;
+    header[FIELD_GRID_WIDTH] = gridWidth;
+    header[FIELD_GRID_HEIGHT] = gridHeight;
+    for (int r = 0; r < gridHeight; r++) {
+      header[FIELDS + r] = rowSplit[r];
+    }
+    for (int c = 0; c < gridWidth; c++) {
+      header[FIELDS + gridHeight + c] = colSplit[c];
+    }
+    ret = MPI_File_write_at(file, 0, header, count, MPI_INT, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+    free(header);
+  }
+
+  MPI_Datatype fileType;
+  MPI_Datatype memoryType;
+  tileTypes(
+      tile, calcOffset(colSplit, rank % gridWidth), calcOffset(rowSplit, rank / gridWidth),
+      imageWidth, imageHeight, &fileType, &memoryType
+  );
+  MPI_File_set_view(file, offset, MPI_BYTE, fileType, "native", MPI_INFO_NULL);
+  ret |= MPI_File_write_all(file, tile->rawdata, 1, memoryType, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+
+  MPI_Type_free(&fileType);
+  MPI_Type_free(&memoryType);
+  MPI_File_close(&file);
+  MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, comm);
+
+  // Only a complete checkpoint replaces the previous one
+  if (ret == 0 && rank == 0) {
+    ret = rename(partname, filename) != 0;
+  }
+  MPI_Bcast(&ret, 1, MPI_INT, 0, comm);
+  return ret;
+}
+
+// Collective, every rank gets the header or NULL if the file can not be
+// read or is not a checkpoint
+checkpointHeader * readCheckpointHeader(char const *filename, MPI_Comm comm) {
+  MPI_File file;
+  if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    return NULL;
+  }
+
+  int fields[FIELDS] = {0};
+  int ret = MPI_File_read_at_all(file, 0, fields, FIELDS, MPI_INT, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+  ret |= fields[FIELD_MAGIC] != CHECKPOINT_MAGIC || fields[FIELD_VERSION] != CHECKPOINT_VERSION;
+  ret |= fields[FIELD_GRID_WIDTH] < 1 || fields[FIELD_GRID_HEIGHT] < 1;
+  if (ret != 0) {
+    MPI_File_close(&file);
+    return NULL;
+  }
+
+  checkpointHeader *header = calloc(1, sizeof(checkpointHeader));
+  header->iteration = fields[FIELD_ITERATION];
+  header->imageWidth = fields[FIELD_WIDTH];
+  header->imageHeight = fields[FIELD_HEIGHT];
+  header->channels = fields[FIELD_CHANNELS];
+  header->gridWidth = fields[FIELD_GRID_WIDTH];
+  header->gridHeight = fields[FIELD_GRID_HEIGHT];
+  header->rowSplit = calloc(header->gridHeight, sizeof(int));
+  header->colSplit = calloc(header->gridWidth, sizeof(int));
+  header->offset = imageOffset(header->gridWidth, header->gridHeight);
+  ret = MPI_File_read_at_all(
+      file, FIELDS * sizeof(int), header->rowSplit, header->gridHeight, MPI_INT, MPI_STATUS_IGNORE
+  ) != MPI_SUCCESS;
+  ret |= MPI_File_read_at_all(
+      file, (FIELDS + header->gridHeight) * sizeof(int), header->colSplit, header->gridWidth, MPI_INT,
+      MPI_STATUS_IGNORE
+  ) != MPI_SUCCESS;
+  MPI_File_close(&file);
+  if (ret != 0) {
+    freeCheckpointHeader(header);
+    return NULL;
+  }
+  return header;
+}
+
+void freeCheckpointHeader(checkpointHeader *header) {
+  if (header == NULL) {
+    return;
+  }
+  free(header->rowSplit);
+  free(header->colSplit);
+  free(header);
+}
+
+// Read the inside of the tile at x0, y0, the ghost cells are left as they are
+int readCheckpointTile(
+  imageTile *tile,
+  char const *filename,
+  checkpointHeader const *header,
+  int x0,
+  int y0,
+  MPI_Comm comm
+) {
+  MPI_File file;
+  if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    return 1;
+  }
+
+  MPI_Datatype fileType;
+  MPI_Datatype memoryType;
+  tileTypes(tile, x0, y0, header->imageWidth, header->imageHeight, &fileType, &memoryType);
+  MPI_File_set_view(file, header->offset, MPI_BYTE, fileType, "native", MPI_INFO_NULL);
+  MPI_Status status;
+  int ret = MPI_File_read_all(file, tile->rawdata, 1, memoryType, &status) != MPI_SUCCESS;
+  int bytesRead = 0;
+  MPI_Get_count(&status, MPI_BYTE, &bytesRead);
+  ret |= (bytesRead != (int)(tile->width * tile->height * tile->channels));
+
+  MPI_Type_free(&fileType);
+  MPI_Type_free(&memoryType);
+  MPI_File_close(&file);
+  MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, comm);
+  return ret;
+}
@@ -0,0 +1,62 @@
+#include <mpi.h>
+#include "tile.h"
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Checkpoints of a run with ghost cells
+//
+// A checkpoint is taken right before a halo exchange, when the ghost cells
+// are about to be received again, so the state of a rank is the inside of
+// its tile. All ranks write their tiles with collective MPI-IO into one
+// image in row order after a small header with the iteration, the image
+// size and the row and column split of the grid. The image does not depend
+// on the grid, so a restart can use any number of ranks, and a restart on
+// the same grid continues with the same, possibly rebalanced, splits.
+//
+// The file is written under <filename>.part and renamed once every rank is
+// done, so an interrupted checkpoint leaves the previous one intact.
+
+#define CHECKPOINT_MAGIC 0x50433341
+#define CHECKPOINT_VERSION 1
+// The image starts at a multiple of this, to keep large writes aligned
+#define CHECKPOINT_ALIGN 4096
+
+typedef struct {
+  // Iterations done when the checkpoint was written
+  int iteration;
+  int imageWidth;
+  int imageHeight;
+  int channels;
+  int gridWidth;
+  int gridHeight;
+  int *rowSplit;
+  int *colSplit;
+  // Offset of the image in the file
+  MPI_Offset offset;
+} checkpointHeader;
+
+int writeCheckpoint(
+  char const *filename,
+  imageTile *tile,
+  int iteration,
+  int imageWidth,
+  int imageHeight,
+  int const *rowSplit,
+  int const *colSplit,
+  int gridWidth,
+  int gridHeight,
+  MPI_Comm comm
+);
+checkpointHeader * readCheckpointHeader(char const *filename, MPI_Comm comm);
+void freeCheckpointHeader(checkpointHeader *header);
+int readCheckpointTile(
+  imageTile *tile,
+  char const *filename,
+  checkpointHeader const *header,
+  int x0,
+  int y0,
+  MPI_Comm comm
+);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+
+// Distance between the bytes the probe looks at
+#define PROBE_STRIDE 16
+
+haloCodec * newHaloCodec(void) {
+  haloCodec *codec = calloc(1, sizeof(haloCodec));
+  return codec;
+}
+
+void freeHaloCodec(haloCodec *codec) {
+  if (codec == NULL) {
+    return;
+  }
+  free(codec->strip);
+  free(codec->send);
+  free(codec->recv);
+  free(codec);
+}
+
+// Buffers for strips of up to bytes bytes. A message is never longer than
+// the strip. Returns 1 if they cannot be allocated, the buffers reserved
+// before stay valid.
+static int reserveHaloCodec(haloCodec *codec, int bytes) {
+  if (bytes <= codec->capacity) {
+    return 0;
+  }
+  unsigned char *strip = realloc(codec->strip, bytes);
+  if (strip != NULL) {
+    codec->strip = strip;
+  }
+  unsigned char *send = realloc(codec->send, bytes);
+  if (send != NULL) {
+    codec->send = send;
+  }
+  unsigned char *recv = realloc(codec->recv, bytes);
+  if (recv != NULL) {
+    codec->recv = recv;
+  }
+  if (strip == NULL || send == NULL || recv == NULL) {
+    return 1;
+  }
+  codec->capacity = bytes;
+  return 0;
+}
+
+// Run-length code a strip into out, which has room for bytes bytes. Returns
+// the length of the coded message, which is shorter than the strip, or
+// bytes if the strip is to be sent as it is.
+int encodeHalo(unsigned char *out, unsigned char const *in, int bytes) {
+  // Every change between two probed bytes means at least one more run, so
+  // the count of changes scaled up estimates the number of runs
+  int changes = 0;
+  for (int i = PROBE_STRIDE; i < bytes; i += PROBE_STRIDE) {
+    changes += (in[i] != in[i - PROBE_STRIDE]);
+  }
+
+  // A run takes two bytes. Counting two runs for every probed change, the
+  // coded strip has to be at most half as long to be worth trying. If the
+  // probe missed too many short runs, coding stops and the strip is sent
+  // as it is.
+  if (bytes > 0 && 2 * 2 * (changes + 1) <= bytes / 2) {
+    int length = 0;
+    int i = 0;
+    while (i < bytes) {
+      int run = 1;
+      while (i + run < bytes && run < 255 && in[i + run] == in[i]) {
+        run++;
+      }
+      if (length + 2 >= bytes) {
+        break;
+      }
+      out[length++] = run;
+      out[length++] = in[i];
+      i += run;
+    }
+    if (i == bytes) {
+      return length;
+    }
+  }
+  return bytes;
+}
+
+// Decode a message of length bytes into a strip of bytes bytes. A message
+// as long as the strip is the strip itself. Returns 1 if the message does
+// not fill the strip exactly.
+int decodeHalo(unsigned char *out, unsigned char const *in, int length, int bytes) {
+  if (length == bytes) {
+    memcpy(out, in, bytes);
+    return 0;
+  }
+  if (length > bytes || length % 2 != 0) {
+    return 1;
+  }
+
+  int filled = 0;
+  for (int i = 0; i < length; i += 2) {
+    int run = in[i];
+    if (filled + run > bytes) {
+      return 1;
+    }
+    memset(&out[filled], in[i + 1], run);
+    filled += run;
+  }
+  return filled != bytes;
+}
+
+// Copy a strip of the frame, rows rows of bytes bytes starting at from, into
+// a contiguous buffer and back
+static void packStrip(unsigned char *to, unsigned char *from, int rows, int bytes, int stride) {
+  for (int y = 0; y < rows; y++) {
+    memcpy(&to[y * bytes], &from[y * stride], bytes);
+  }
+}
+
+static void unpackStrip(unsigned char *to, unsigned char const *from, int rows, int bytes, int stride) {
+  for (int y = 0; y < rows; y++) {
+    memcpy(&to[y * stride], &from[y * bytes], bytes);
+  }
+}
+
+// Send a strip to one neighbour and receive the matching strip from the
+// other one
+static void exchangeStrip(
+  haloCodec *codec,
+  unsigned char *send,
+  int sendTo,
+  unsigned char *recv,
+  int recvFrom,
+  int rows,
+  int bytes,
+  int stride,
+  int tag,
+  MPI_Comm comm
+) {
+  int const total = rows * bytes;
+  unsigned char *message = codec->strip;
+  int length = 0;
+  if (sendTo != MPI_PROC_NULL) {
+    packStrip(codec->strip, send, rows, bytes, stride);
+    length = encodeHalo(codec->send, codec->strip, total);
+    if (length < total) {
+      message = codec->send;
+      codec->compressed++;
+    }
+    codec->rawBytes += total;
+    codec->sentBytes += length;
+    codec->messages++;
+  }
+
+  MPI_Status status;
+  MPI_Sendrecv(
+    message, length, MPI_BYTE, sendTo, tag,
+    codec->recv, total, MPI_BYTE, recvFrom, tag,
+    comm, &status
+  );
+
+  if (recvFrom != MPI_PROC_NULL) {
+    int received;
+    MPI_Get_count(&status, MPI_BYTE, &received);
+    // A strip sent as it is goes into the frame without another copy
+    unsigned char const *strip = codec->recv;
+    if (received != total) {
+      if (decodeHalo(codec->strip, codec->recv, received, total) != 0) {
+        MPI_Abort(comm, 1);
+      }
+      strip = codec->strip;
+    }
+    unpackStrip(recv, strip, rows, bytes, stride);
+  }
+}
+
+// Same exchange as exchangeTileHalo, with every strip compressed on its own.
+// Returns 1 without exchanging anything if the buffers cannot be allocated.
+int exchangeTileHaloCompressed(imageTile *tile, tileExchange *exchange, haloCodec *codec) {
+  int const count = tile->count;
+  int const width = tile->width;
+  int const height = tile->height;
+  int const channels = tile->channels;
+  int const stride = tile->stride;
+  int const side = count * channels;
+  if (reserveHaloCodec(codec, count * stride) != 0 || reserveHaloCodec(codec, height * side) != 0) {
+    return 1;
+  }
+
+  // East and west halos, count columns of every row inside the tile
+  exchangeStrip(codec,
+      &tile->data[0][(width - count) * channels], exchange->east,
+      &tile->data[0][-side], exchange->west,
+      height, side, stride, 0, exchange->comm);
+  exchangeStrip(codec,
+      &tile->data[0][0], exchange->west,
+      &tile->data[0][width * channels], exchange->east,
+      height, side, stride, 1, exchange->comm);
+
+  // North and south halos, whole rows of the frame including the corners
+  exchangeStrip(codec,
+      &tile->data[height - count][-side], exchange->south,
+      &tile->data[-count][-side], exchange->north,
+      count, stride, stride, 2, exchange->comm);
+  exchangeStrip(codec,
+      &tile->data[0][-side], exchange->north,
+      &tile->data[height][-side], exchange->south,
+      count, stride, stride, 3, exchange->comm);
+  return 0;
+}
@@ -0,0 +1,36 @@
+#include "tile.h"
+
+#ifndef CODEC_H
+#define CODEC_H
+
+// Compressed halo exchange
+//
+// After a few iterations of an edge or Laplacian kernel the halo strips are
+// mostly long runs of the same byte. Every strip is packed into a buffer and
+// a cheap probe over a sample of the strip estimates the number of runs. If
+// run-length coding promises to save enough, the strip is sent as pairs of
+// run length and value, otherwise as it is. A coded message is always
+// shorter than the strip, so its length tells the receiver which of the two
+// it got, and a strip never costs more than in the plain exchange. The
+// receiver rebuilds the exact strip.
+
+typedef struct {
+  unsigned char *strip;
+  unsigned char *send;
+  unsigned char *recv;
+  int capacity;
+  // Bytes the halos would take uncompressed, bytes actually sent, messages
+  // sent and how many of them were run-length coded
+  double rawBytes;
+  double sentBytes;
+  int messages;
+  int compressed;
+} haloCodec;
+
+haloCodec * newHaloCodec(void);
+void freeHaloCodec(haloCodec *codec);
+int encodeHalo(unsigned char *out, unsigned char const *in, int bytes);
+int decodeHalo(unsigned char *out, unsigned char const *in, int length, int bytes);
+int exchangeTileHaloCompressed(imageTile *tile, tileExchange *exchange, haloCodec *codec);
+
+#endif
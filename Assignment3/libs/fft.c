@@ -0,0 +1,181 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fft.h"
+#ifdef HAVE_FFTW
+#include <fftw3.h>
+#endif
+
+// Largest transform the planner considers
+#define FFT_MAX_SIZE 4096
+// Cost of a radix-2 butterfly and of multiplying two complex values, in
+// vectorised multiply-adds of a direct convolution, measured on AVX2
+#define FFT_BUTTERFLY_COST 8.0
+#define FFT_MULTIPLY_COST 4.0
+
+fftTable * newFftTable(int size) {
+  fftTable *table = calloc(1, sizeof(fftTable));
+  if (table == NULL) {
+    return NULL;
+  }
+  table->size = size;
+  table->reverse = malloc(size * sizeof(int));
+  table->twiddles = malloc(size * sizeof(float));
+  int bits = 0;
+  while ((1 << bits) < size) {
+    bits++;
+  }
+  for (int i = 0; i < size; i++) {
+    int r = 0;
+    for (int b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    table->reverse[i] = r;
+  }
+  for (int k = 0; k < size / 2; k++) {
+    table->twiddles[2 * k] = cos(2 * M_PI * k / size);
+    table->twiddles[2 * k + 1] = -sin(2 * M_PI * k / size);
+  }
+
+#ifdef HAVE_FFTW
+  // Planned once on this buffer, executed on the buffers of every thread
+  float *buffer = newFftBuffer(size);
+  table->forward = fftwf_plan_dft_2d(
+      size, size, (fftwf_complex *)buffer, (fftwf_complex *)buffer, FFTW_FORWARD, FFTW_ESTIMATE
+  );
+  table->inverse = fftwf_plan_dft_2d(
+      size, size, (fftwf_complex *)buffer, (fftwf_complex *)buffer, FFTW_BACKWARD, FFTW_ESTIMATE
+  );
+  freeFftBuffer(buffer);
+#endif
+  return table;
+}
+
+void freeFftTable(fftTable *table) {
+  if (table == NULL) {
+    return;
+  }
+#ifdef HAVE_FFTW
+  fftwf_destroy_plan((fftwf_plan)table->forward);
+  fftwf_destroy_plan((fftwf_plan)table->inverse);
+#endif
+  free(table->reverse);
+  free(table->twiddles);
+  free(table);
+}
+
+// size x size complex values, aligned as the transforms need them
+float * newFftBuffer(int size) {
+#ifdef HAVE_FFTW
+  return fftwf_malloc(2 * (size_t)size * size * sizeof(float));
+#else
+  return malloc(2 * (size_t)size * size * sizeof(float));
+#endif
+}
+
+void freeFftBuffer(float *buffer) {
+#ifdef HAVE_FFTW
+  fftwf_free(buffer);
+#else
+  free(buffer);
+#endif
+}
+
+#ifndef HAVE_FFTW
+// Iterative radix-2 transform of one line of complex values in place
+static void fftLine(float *restrict data, fftTable const *table, int inverse) {
+  int const size = table->size;
+  for (int i = 0; i < size; i++) {
+    int j = table->reverse[i];
+    if (j > i) {
+      float re = data[2 * i];
+      float im = data[2 * i + 1];
+      data[2 * i] = data[2 * j];
+      data[2 * i + 1] = data[2 * j + 1];
+      data[2 * j] = re;
+      data[2 * j + 1] = im;
+    }
+  }
+  float const sign = inverse ? -1.0f : 1.0f;
+  for (int half = 1; half < size; half *= 2) {
+    int const step = size / (2 * half);
+    for (int k = 0; k < half; k++) {
+      float const wr = table->twiddles[2 * k * step];
+      float const wi = sign * table->twiddles[2 * k * step + 1];
+      for (int start = k; start < size; start += 2 * half) {
+        float *a = &data[2 * start];
+        float *b = &data[2 * (start + half)];
+        float tr = b[0] * wr - b[1] * wi;
+        float ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
+
+// Transpose of size x size complex values in blocks that stay in cache
+static void transpose(float *restrict to, float const *restrict from, int size) {
+  int const block = 16;
+  for (int y0 = 0; y0 < size; y0 += block) {
+    for (int x0 = 0; x0 < size; x0 += block) {
+      int y1 = (y0 + block < size) ? y0 + block : size;
+      int x1 = (x0 + block < size) ? x0 + block : size;
+      for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+          to[2 * (x * size + y)] = from[2 * (y * size + x)];
+          to[2 * (x * size + y) + 1] = from[2 * (y * size + x) + 1];
+        }
+      }
+    }
+  }
+}
+#endif
+
+// 2-D transform of size x size complex values in place. The inverse is not
+// scaled by 1 / size^2. scratch holds as many values and is only used by
+// the in-tree transform.
+void fft2d(float *data, float *scratch, fftTable const *table, int inverse) {
+#ifdef HAVE_FFTW
+  (void)scratch;
+  fftwf_execute_dft(
+      (fftwf_plan)(inverse ? table->inverse : table->forward),
+      (fftwf_complex *)data, (fftwf_complex *)data
+  );
+#else
+  int const size = table->size;
+  for (int y = 0; y < size; y++) {
+    fftLine(&data[2 * y * size], table, inverse);
+  }
+  transpose(scratch, data, size);
+  for (int y = 0; y < size; y++) {
+    fftLine(&scratch[2 * y * size], table, inverse);
+  }
+  memcpy(data, scratch, 2 * (size_t)size * size * sizeof(float));
+#endif
+}
+
+// Size of the transforms for the cheapest overlap-save convolution of a
+// dim x dim kernel over width x height pixels, or 0 if the direct
+// convolution at directCost multiply-adds per pixel is cheaper
+int chooseFftSize(int dim, int width, int height, double directCost) {
+  int best = 0;
+  double bestCost = directCost;
+  for (int size = 2; size <= FFT_MAX_SIZE; size *= 2) {
+    int block = size - dim + 1;
+    if (block < 1) {
+      continue;
+    }
+    double blocks = (double)((width + block - 1) / block) * ((height + block - 1) / block);
+    double transform = (double)size * size * log2(size) * FFT_BUTTERFLY_COST;
+    // Two blocks share the two transforms and the multiplication
+    double cost = blocks * (transform + (double)size * size * FFT_MULTIPLY_COST / 2) / ((double)width * height);
+    if (cost < bestCost) {
+      best = size;
+      bestCost = cost;
+    }
+  }
+  return best;
+}
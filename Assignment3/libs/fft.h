@@ -0,0 +1,37 @@
+#ifndef FFT_H
+#define FFT_H
+
+// Fast Fourier transforms for convolutions with large kernels
+//
+// Transforms are square, of a power of two size, on interleaved complex
+// single precision values. The in-tree radix-2 transform does the rows,
+// transposes and does the rows again, so its spectrum is transposed; the
+// inverse takes that layout back. Built with HAVE_FFTW (see the Makefile)
+// FFTW does the transforms instead. Either way, a spectrum is only ever
+// multiplied with another spectrum from the same table, so the layout does
+// not matter.
+//
+// A kernel plan with an fftSize convolves by overlap-save: the region is cut
+// into blocks of fftSize - dim + 1 pixels, every block is transformed with
+// the dim - 1 cells of input around it, multiplied with the cached spectrum
+// of the kernel and transformed back, and the part of the result not
+// wrapped around is the output of the block. Two blocks share one complex
+// transform as its real and imaginary part, since the kernel is real.
+
+typedef struct {
+  int size;
+  int *reverse;
+  // cos and -sin of 2 pi k / size for k < size / 2
+  float *twiddles;
+  void *forward;
+  void *inverse;
+} fftTable;
+
+fftTable * newFftTable(int size);
+void freeFftTable(fftTable *table);
+float * newFftBuffer(int size);
+void freeFftBuffer(float *buffer);
+void fft2d(float *data, float *scratch, fftTable const *table, int inverse);
+int chooseFftSize(int dim, int width, int height, double directCost);
+
+#endif
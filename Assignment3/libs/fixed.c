@@ -0,0 +1,429 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "fixed.h"
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// One lane in plain C, with the same wrap-around and saturation as the
+// vector lanes. Used for the pixels at the end of a row.
+
+static inline uint16_t scalarMultiplyAdd(uint16_t acc, uint16_t value, int16_t weight) {
+  return (uint16_t)(acc + (uint16_t)(value * weight));
+}
+
+static inline unsigned char scalarPack(uint16_t acc, int shift, int mode) {
+  if (mode == FIXED_POINT_SIGNED) {
+    int value = (int16_t)acc >> shift;
+    return (value > 255) ? 255 : ((value < 0) ? 0 : value);
+  }
+  unsigned int value = acc >> shift;
+  return (value > 255) ? 255 : value;
+}
+
+#if defined(__AVX512BW__)
+
+#define FIXED_LANES 32
+typedef __m512i fixedVector;
+
+static inline fixedVector fixedZero(void) {
+  return _mm512_setzero_si512();
+}
+
+static inline fixedVector fixedWidenBytes(unsigned char const *p) {
+  return _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const *)p));
+}
+
+static inline fixedVector fixedLoad(uint16_t const *p) {
+  return _mm512_loadu_si512(p);
+}
+
+static inline void fixedStore(uint16_t *p, fixedVector v) {
+  _mm512_storeu_si512(p, v);
+}
+
+static inline fixedVector fixedMultiplyAdd(fixedVector acc, fixedVector v, int16_t weight) {
+  return _mm512_add_epi16(acc, _mm512_mullo_epi16(v, _mm512_set1_epi16(weight)));
+}
+
+static inline void fixedPack(unsigned char *p, fixedVector acc, int shift, int mode) {
+  __m128i count = _mm_cvtsi32_si128(shift);
+  if (mode == FIXED_POINT_SIGNED) {
+    acc = _mm512_max_epi16(_mm512_sra_epi16(acc, count), _mm512_setzero_si512());
+  } else {
+    acc = _mm512_srl_epi16(acc, count);
+  }
+  // Narrowing with unsigned saturation clamps to 255
+  _mm256_storeu_si256((__m256i *)p, _mm512_cvtusepi16_epi8(acc));
+}
+
+#elif defined(__AVX2__)
+
+#define FIXED_LANES 16
+typedef __m256i fixedVector;
+
+static inline fixedVector fixedZero(void) {
+  return _mm256_setzero_si256();
+}
+
+static inline fixedVector fixedWidenBytes(unsigned char const *p) {
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *)p));
+}
+
+static inline fixedVector fixedLoad(uint16_t const *p) {
+  return _mm256_loadu_si256((__m256i const *)p);
+}
+
+static inline void fixedStore(uint16_t *p, fixedVector v) {
+  _mm256_storeu_si256((__m256i *)p, v);
+}
+
+static inline fixedVector fixedMultiplyAdd(fixedVector acc, fixedVector v, int16_t weight) {
+  return _mm256_add_epi16(acc, _mm256_mullo_epi16(v, _mm256_set1_epi16(weight)));
+}
+
+static inline void fixedPack(unsigned char *p, fixedVector acc, int shift, int mode) {
+  __m128i count = _mm_cvtsi32_si128(shift);
+  if (mode == FIXED_POINT_SIGNED) {
+    acc = _mm256_sra_epi16(acc, count);
+  } else {
+    acc = _mm256_min_epu16(_mm256_srl_epi16(acc, count), _mm256_set1_epi16(255));
+  }
+  // Signed saturation to [0, 255] packs each 128-bit half separately, so the
+  // two 64-bit results are moved next to each other afterwards
+  __m256i packed = _mm256_packus_epi16(acc, acc);
+  packed = _mm256_permute4x64_epi64(packed, 0xD8);
+  _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(packed));
+}
+
+#else
+
+#define FIXED_LANES 1
+typedef uint16_t fixedVector;
+
+static inline fixedVector fixedZero(void) {
+  return 0;
+}
+
+static inline fixedVector fixedWidenBytes(unsigned char const *p) {
+  return *p;
+}
+
+static inline fixedVector fixedLoad(uint16_t const *p) {
+  return *p;
+}
+
+static inline void fixedStore(uint16_t *p, fixedVector v) {
+  *p = v;
+}
+
+static inline fixedVector fixedMultiplyAdd(fixedVector acc, fixedVector v, int16_t weight) {
+  return scalarMultiplyAdd(acc, v, weight);
+}
+
+static inline void fixedPack(unsigned char *p, fixedVector acc, int shift, int mode) {
+  *p = scalarPack(acc, shift, mode);
+}
+
+#endif
+
+int fixedPointLanes(void) {
+  return FIXED_LANES;
+}
+
+int fixedPointMode(kernelPlan const *plan, int *low, int *high) {
+  kernelEntry const *entry = plan->entry;
+  // Entries without weights are not convolutions and have no range
+  int dim = (entry->kernel != NULL) ? entry->dim : 0;
+  long long lo = 0;
+  long long hi = 0;
+
+  // Range of the sum for inputs in [0, 255]. For a rank-1 kernel the range
+  // of the horizontal pass is scaled by the column weights.
+  if (plan->rowKernel != NULL) {
+    long long rowLo = 0;
+    long long rowHi = 0;
+    for (int i = 0; i < dim; i++) {
+      int weight = plan->rowKernel[i];
+      rowLo += (weight < 0) ? 255LL * weight : 0;
+      rowHi += (weight > 0) ? 255LL * weight : 0;
+    }
+    for (int i = 0; i < dim; i++) {
+      int weight = plan->columnKernel[i];
+      lo += (weight > 0) ? weight * rowLo : weight * rowHi;
+      hi += (weight > 0) ? weight * rowHi : weight * rowLo;
+    }
+  } else {
+    for (int i = 0; i < dim * dim; i++) {
+      int weight = entry->kernel[i];
+      lo += (weight < 0) ? 255LL * weight : 0;
+      hi += (weight > 0) ? 255LL * weight : 0;
+    }
+  }
+  if (low != NULL) {
+    *low = lo;
+  }
+  if (high != NULL) {
+    *high = hi;
+  }
+
+  if (entry->kernel == NULL || plan->shift < 0 || plan->shift > 15) {
+    return FIXED_POINT_NONE;
+  }
+  if (lo >= INT16_MIN && hi <= INT16_MAX) {
+    return FIXED_POINT_SIGNED;
+  }
+  if (lo >= 0 && hi <= UINT16_MAX) {
+    return FIXED_POINT_UNSIGNED;
+  }
+  return FIXED_POINT_NONE;
+}
+
+typedef struct {
+  int row;
+  int column;
+  int16_t weight;
+} fixedTap;
+
+static void fixedRow(
+  unsigned char *out,
+  unsigned char **rows,
+  int x0,
+  int x1,
+  fixedTap const *taps,
+  int tapCount,
+  int shift,
+  int mode
+) {
+  int x = x0;
+  for (; x + FIXED_LANES <= x1; x += FIXED_LANES) {
+    fixedVector acc = fixedZero();
+    for (int t = 0; t < tapCount; t++) {
+      acc = fixedMultiplyAdd(acc, fixedWidenBytes(&rows[taps[t].row][x + taps[t].column]), taps[t].weight);
+    }
+    fixedPack(&out[x], acc, shift, mode);
+  }
+  for (; x < x1; x++) {
+    uint16_t acc = 0;
+    for (int t = 0; t < tapCount; t++) {
+      acc = scalarMultiplyAdd(acc, rows[taps[t].row][x + taps[t].column], taps[t].weight);
+    }
+    out[x] = scalarPack(acc, shift, mode);
+  }
+}
+
+// Number of output rows one thread computes with a buffer of 1-D results
+#define FIXED_CHUNK_ROWS 32
+
+static void applyFixedPointSeparable(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+) {
+  int const dim = plan->entry->dim;
+  int const center = plan->radius;
+  int const shift = plan->shift;
+  int const mode = plan->fixedPoint;
+  int const channels = in->channels;
+  int const width = (region->x1 - region->x0) * channels;
+  int const height = region->y1 - region->y0;
+  int const chunks = (height + FIXED_CHUNK_ROWS - 1) / FIXED_CHUNK_ROWS;
+
+  #pragma omp parallel
+  {
+    uint16_t *rows = malloc((FIXED_CHUNK_ROWS + 2 * center) * width * sizeof(uint16_t));
+
+    #pragma omp for schedule(static)
+    for (int chunk = 0; chunk < chunks; chunk++) {
+      int y0 = region->y0 + chunk * FIXED_CHUNK_ROWS;
+      int y1 = (y0 + FIXED_CHUNK_ROWS < region->y1) ? y0 + FIXED_CHUNK_ROWS : region->y1;
+
+      // Horizontal pass over every input row of the chunk
+      for (int y = y0 - center; y < y1 + center; y++) {
+        uint16_t *dst = &rows[(y - y0 + center) * width];
+        unsigned char const *src = &in->data[y][(region->x0 - center) * channels];
+        int x = 0;
+        for (; x + FIXED_LANES <= width; x += FIXED_LANES) {
+          fixedVector acc = fixedZero();
+          for (int kx = 0; kx < dim; kx++) {
+            if (plan->rowKernel[kx] != 0) {
+              acc = fixedMultiplyAdd(acc, fixedWidenBytes(&src[x + kx * channels]), plan->rowKernel[kx]);
+            }
+          }
+          fixedStore(&dst[x], acc);
+        }
+        for (; x < width; x++) {
+          uint16_t acc = 0;
+          for (int kx = 0; kx < dim; kx++) {
+            acc = scalarMultiplyAdd(acc, src[x + kx * channels], plan->rowKernel[kx]);
+          }
+          dst[x] = acc;
+        }
+      }
+
+      // Vertical pass
+      for (int y = y0; y < y1; y++) {
+        unsigned char *dst = &out->data[y][region->x0 * channels];
+        uint16_t const *src = &rows[(y - y0) * width];
+        int x = 0;
+        for (; x + FIXED_LANES <= width; x += FIXED_LANES) {
+          fixedVector acc = fixedZero();
+          for (int ky = 0; ky < dim; ky++) {
+            if (plan->columnKernel[ky] != 0) {
+              acc = fixedMultiplyAdd(acc, fixedLoad(&src[ky * width + x]), plan->columnKernel[ky]);
+            }
+          }
+          fixedPack(&dst[x], acc, shift, mode);
+        }
+        for (; x < width; x++) {
+          uint16_t acc = 0;
+          for (int ky = 0; ky < dim; ky++) {
+            acc = scalarMultiplyAdd(acc, src[ky * width + x], plan->columnKernel[ky]);
+          }
+          dst[x] = scalarPack(acc, shift, mode);
+        }
+      }
+    }
+
+    free(rows);
+  }
+}
+
+void applyFixedPointKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+) {
+  if (plan->rowKernel != NULL) {
+    applyFixedPointSeparable(out, in, region, plan);
+    return;
+  }
+
+  kernelEntry const *entry = plan->entry;
+  int const dim = entry->dim;
+  int const center = plan->radius;
+  int const channels = in->channels;
+
+  // Only the taps with a weight, flipped like in applyTileKernel. Columns
+  // are byte offsets, one pixel of channels apart.
+  fixedTap *taps = malloc(dim * dim * sizeof(fixedTap));
+  int tapCount = 0;
+  for (int ky = 0; ky < dim; ky++) {
+    for (int kx = 0; kx < dim; kx++) {
+      int weight = entry->kernel[(dim - 1 - ky) * dim + (dim - 1 - kx)];
+      if (weight != 0) {
+        taps[tapCount].row = ky;
+        taps[tapCount].column = (kx - center) * channels;
+        taps[tapCount].weight = weight;
+        tapCount++;
+      }
+    }
+  }
+
+  #pragma omp parallel for schedule(static)
+  for (int y = region->y0; y < region->y1; y++) {
+    unsigned char *rows[dim];
+    for (int ky = 0; ky < dim; ky++) {
+      rows[ky] = in->data[y + ky - center];
+    }
+    fixedRow(out->data[y], rows, region->x0 * channels, region->x1 * channels, taps, tapCount,
+        plan->shift, plan->fixedPoint);
+  }
+
+  free(taps);
+}
+
+// Size of the tiles used to verify the fixed-point path. The width is not a
+// multiple of the vector lanes so the scalar end of the rows is covered too.
+#define VERIFY_WIDTH 203
+#define VERIFY_HEIGHT 61
+
+// Fill the whole frame of a tile, ghost cells included, with a test pattern.
+// Patterns 1 and 2 repeat the sign of the kernel weights with the period of
+// the kernel, which gives the largest and smallest possible sum at every
+// pixel whose coordinates are multiples of the kernel dimension.
+static void fillVerifyTile(imageTile *tile, kernelEntry const *entry, int pattern) {
+  int dim = entry->dim;
+  int center = dim / 2;
+  int count = tile->count;
+  srand(pattern + 1);
+  for (int y = -count; y < (int)tile->height + count; y++) {
+    for (int x = -count; x < (int)tile->width + count; x++) {
+      int ky = ((y + center) % dim + dim) % dim;
+      int kx = ((x + center) % dim + dim) % dim;
+      int weight = entry->kernel[(dim - 1 - ky) * dim + (dim - 1 - kx)];
+      switch (pattern) {
+        case 0:
+          tile->data[y][x] = rand() % 256;
+          break;
+        case 1:
+          tile->data[y][x] = (weight > 0) ? 255 : 0;
+          break;
+        case 2:
+          tile->data[y][x] = (weight < 0) ? 255 : 0;
+          break;
+        default:
+          tile->data[y][x] = 255;
+          break;
+      }
+    }
+  }
+}
+
+// Compare the fixed-point path with the generic per-tap applyTileKernel for
+// every registered kernel on random data, on data giving the extreme sums and
+// on a saturated image. The separable and specialised paths are bypassed, so
+// the reference does not depend on any other optimised path. Returns the
+// number of kernels with a mismatch.
+int verifyFixedPointKernels(FILE *out) {
+  char const *modes[] = {"scalar only", "int16", "uint16"};
+  int failed = 0;
+
+  fprintf(out, "16-bit fixed point with %d lanes\n", FIXED_LANES);
+  for (kernelEntry const *entry = kernelRegistry; entry->name != NULL; entry++) {
+    if (entry->kernel == NULL) {
+      continue;
+    }
+    kernelPlan *plan = newKernelPlan(entry);
+    int low;
+    int high;
+    int mode = fixedPointMode(plan, &low, &high);
+    fprintf(out, "%-12s sum in [%d, %d], shift %d: %s", entry->name, low, high, plan->shift, modes[mode]);
+    if (mode == FIXED_POINT_NONE) {
+      fprintf(out, "\n");
+      freeKernelPlan(plan);
+      continue;
+    }
+
+    int count = plan->radius;
+    imageTile *in = newImageTile(VERIFY_WIDTH, VERIFY_HEIGHT, count, 1);
+    imageTile *scalar = newImageTile(VERIFY_WIDTH, VERIFY_HEIGHT, count, 1);
+    imageTile *fixed = newImageTile(VERIFY_WIDTH, VERIFY_HEIGHT, count, 1);
+    tileRegion region = {0, VERIFY_WIDTH, 0, VERIFY_HEIGHT};
+
+    int mismatches = 0;
+    for (int pattern = 0; pattern < 4; pattern++) {
+      fillVerifyTile(in, entry, pattern);
+      applyTileKernel(scalar, in, &region, entry->kernel, entry->dim, entry->factor);
+      applyKernelPlan(fixed, in, &region, plan);
+      for (int y = 0; y < VERIFY_HEIGHT; y++) {
+        for (int x = 0; x < VERIFY_WIDTH; x++) {
+          if (scalar->data[y][x] != fixed->data[y][x]) {
+            mismatches++;
+          }
+        }
+      }
+    }
+    fprintf(out, ", %d mismatches\n", mismatches);
+    failed += (mismatches > 0);
+
+    freeImageTile(in);
+    freeImageTile(scalar);
+    freeImageTile(fixed);
+    freeKernelPlan(plan);
+  }
+  return failed;
+}
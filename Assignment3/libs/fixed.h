@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include "kernel.h"
+
+#ifndef FIXED_H
+#define FIXED_H
+
+// 16-bit fixed-point convolution
+//
+// For 8-bit input and small integer kernels every sum fits in 16 bits, so a
+// vector register holds 16 (AVX2) or 32 (AVX-512) pixels. Pixels are widened
+// to 16 bits, multiplied and accumulated, shifted by the kernel factor and
+// packed back to 8 bits with saturation, which is the clamp to [0, 255].
+//
+// 16-bit additions and multiplications wrap around, so the computed sum is
+// the exact sum modulo 2^16, regardless of overflow in partial sums. The
+// result is therefore exact if the range of the final sum, found by interval
+// arithmetic over the weights, fits in the lanes as signed or unsigned 16-bit
+// values. Only kernels with a factor of 1/2^n qualify.
+
+#define FIXED_POINT_NONE 0
+#define FIXED_POINT_SIGNED 1
+#define FIXED_POINT_UNSIGNED 2
+
+int fixedPointLanes(void);
+int fixedPointMode(kernelPlan const *plan, int *low, int *high);
+void applyFixedPointKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+);
+int verifyFixedPointKernels(FILE *out);
+
+#endif
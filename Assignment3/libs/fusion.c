@@ -0,0 +1,243 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fusion.h"
+#include "fixed.h"
+#include "morphology.h"
+#include "spectral.h"
+
+// Why the iterations of the pipeline can not be fused, or NULL if they can
+char const * fusionObstacle(kernelPipeline const *pipeline) {
+  if (pipeline->stages != 1) {
+    return "only a single kernel is fused";
+  }
+  kernelPlan const *plan = pipeline->plans[0];
+  kernelEntry const *entry = plan->entry;
+  if (entry->kernel == NULL || plan->box > 0 || plan->rankRadius > 0 ||
+      plan->morphology != MORPHOLOGY_NONE) {
+    return "only registered convolution kernels are fused";
+  }
+
+  // Bounds of one iteration: with no negative weights the result is at
+  // least 0, and with the weights summing to at most 1 / factor at most 255
+  double sum = 0;
+  for (unsigned int i = 0; i < entry->dim * entry->dim; i++) {
+    if (entry->kernel[i] < 0) {
+      return "negative weights, the clamp to 0 can trigger";
+    }
+    sum += entry->kernel[i];
+  }
+  if (sum == 0) {
+    return "all weights are zero";
+  }
+  if (sum * entry->factor > 1 + 1e-6) {
+    return "the weights sum to more than 1 / factor, the clamp to 255 can trigger";
+  }
+  return NULL;
+}
+
+// n-fold self-convolution of the kernel of length dim, normalised to a sum
+// of one, into composed of length n * (dim - 1) + 1
+static void composeKernel(double *composed, int const *kernel, int dim, int n) {
+  double sum = 0;
+  for (int i = 0; i < dim; i++) {
+    sum += kernel[i];
+  }
+  int length = 1;
+  composed[0] = 1;
+  double *next = malloc((n * (dim - 1) + 1) * sizeof(double));
+  for (int k = 0; k < n; k++) {
+    for (int i = 0; i < length + dim - 1; i++) {
+      next[i] = 0;
+    }
+    for (int i = 0; i < length; i++) {
+      for (int j = 0; j < dim; j++) {
+        next[i + j] += composed[i] * kernel[j] / sum;
+      }
+    }
+    length += dim - 1;
+    memcpy(composed, next, length * sizeof(double));
+  }
+  free(next);
+}
+
+// n-fold self-convolution of the dim x dim kernel, times factor^n, into
+// composed of length x length with length = n * (dim - 1) + 1
+static void composeKernel2d(double *composed, int const *kernel, int dim, double factor, int n) {
+  int length = 1;
+  composed[0] = 1;
+  int total = n * (dim - 1) + 1;
+  double *next = malloc(total * total * sizeof(double));
+  for (int k = 0; k < n; k++) {
+    int grown = length + dim - 1;
+    for (int i = 0; i < grown * grown; i++) {
+      next[i] = 0;
+    }
+    for (int y = 0; y < length; y++) {
+      for (int x = 0; x < length; x++) {
+        double value = composed[y * length + x] * factor;
+        for (int ky = 0; ky < dim; ky++) {
+          for (int kx = 0; kx < dim; kx++) {
+            next[(y + ky) * grown + x + kx] += value * kernel[ky * dim + kx];
+          }
+        }
+      }
+    }
+    length = grown;
+    memcpy(composed, next, length * length * sizeof(double));
+  }
+  free(next);
+}
+
+// Pipeline of one kernel running the given number of iterations of the
+// single kernel of pipeline at once, see fusionObstacle. A rank-1 kernel
+// runs as two 1-D passes unless FFTs over tiles of width x height are
+// cheaper, any other kernel always through FFTs. Returns NULL if the
+// kernel is too large for the transforms.
+kernelPipeline * fuseKernelPipeline(kernelPipeline const *pipeline, int iterations, int width, int height) {
+  kernelPlan const *base = pipeline->plans[0];
+  kernelEntry const *entry = base->entry;
+  int dim = entry->dim;
+  int length = iterations * (dim - 1) + 1;
+  bool separable = base->rowKernel != NULL;
+  int size = chooseFftSize(length, width, height, separable ? 2.0 * length : HUGE_VAL);
+  if (!separable && size == 0) {
+    return NULL;
+  }
+
+  kernelPipeline *fused = calloc(1, sizeof(kernelPipeline));
+  fused->stages = 1;
+  fused->plans = calloc(1, sizeof(kernelPlan *));
+  kernelPlan *plan = newKernelPlan(entry);
+  fused->plans[0] = plan;
+  plan->radius = length / 2;
+  plan->fused = iterations;
+  plan->fixedPoint = FIXED_POINT_NONE;
+  fused->radius = plan->radius;
+
+  if (!separable) {
+    // The 2-D kernel is flipped like the vectors of a rank-1 kernel
+    double *composed = malloc(length * length * sizeof(double));
+    double *weights = malloc(length * length * sizeof(double));
+    composeKernel2d(composed, entry->kernel, dim, entry->factor, iterations);
+    for (int i = 0; i < length * length; i++) {
+      weights[i] = composed[length * length - 1 - i];
+    }
+    int failed = setSpectralKernel(plan, weights, length, size);
+    free(composed);
+    free(weights);
+    if (failed) {
+      freeKernelPipeline(fused);
+      return NULL;
+    }
+    return fused;
+  }
+
+  // The factor spreads over the sums of both vectors, whatever their
+  // scale; with a normalised kernel the scale is one
+  double columnSum = 0;
+  double rowSum = 0;
+  for (int i = 0; i < dim; i++) {
+    columnSum += base->columnKernel[i];
+    rowSum += base->rowKernel[i];
+  }
+  double scale = 1;
+  for (int k = 0; k < iterations; k++) {
+    scale *= columnSum * rowSum * entry->factor;
+  }
+
+  double *column = malloc(length * sizeof(double));
+  double *row = malloc(length * sizeof(double));
+  composeKernel(column, base->columnKernel, dim, iterations);
+  composeKernel(row, base->rowKernel, dim, iterations);
+  plan->fusedColumn = malloc(length * sizeof(float));
+  plan->fusedRow = malloc(length * sizeof(float));
+  for (int i = 0; i < length; i++) {
+    // The far tails would be denormal, slowing down every multiply-add
+    // they take part in for nothing after rounding
+    double r = row[i] * scale;
+    plan->fusedColumn[i] = (column[i] < FLT_MIN) ? 0 : column[i];
+    plan->fusedRow[i] = (r < FLT_MIN) ? 0 : r;
+  }
+
+  int failed = 0;
+  if (size > 0) {
+    double *weights = malloc(length * length * sizeof(double));
+    for (int y = 0; y < length; y++) {
+      for (int x = 0; x < length; x++) {
+        weights[y * length + x] = column[y] * row[x] * scale;
+      }
+    }
+    failed = setSpectralKernel(plan, weights, length, size);
+    free(weights);
+  }
+  free(column);
+  free(row);
+  if (failed) {
+    freeKernelPipeline(fused);
+    return NULL;
+  }
+  return fused;
+}
+
+// Both passes of the composed kernel over one row of the region at a time.
+// The column pass covers the radius left and right of the region, so the
+// row pass reads only values of this row.
+void applyFusedKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+) {
+  int const radius = plan->radius;
+  int const length = 2 * radius + 1;
+  int const channels = in->channels;
+  int const width = (region->x1 - region->x0) * channels;
+  int const columns = width + 2 * radius * channels;
+  float const *restrict column = plan->fusedColumn;
+  float const *restrict row = plan->fusedRow;
+
+  #pragma omp parallel
+  {
+    float *restrict sums = malloc(columns * sizeof(float));
+    float *restrict values = malloc(width * sizeof(float));
+
+    #pragma omp for schedule(static)
+    for (int y = region->y0; y < region->y1; y++) {
+      for (int x = 0; x < columns; x++) {
+        sums[x] = 0;
+      }
+      for (int ky = 0; ky < length; ky++) {
+        unsigned char const *src = &in->data[y + ky - radius][(region->x0 - radius) * channels];
+        float const weight = column[ky];
+        for (int x = 0; x < columns; x++) {
+          sums[x] += src[x] * weight;
+        }
+      }
+
+      for (int x = 0; x < width; x++) {
+        values[x] = 0;
+      }
+      for (int kx = 0; kx < length; kx++) {
+        float const *src = &sums[kx * channels];
+        float const weight = row[kx];
+        for (int x = 0; x < width; x++) {
+          values[x] += src[x] * weight;
+        }
+      }
+
+      // Rounded once to the nearest value, the bounds keep it in 0..255
+      // up to rounding errors of the single precision sums
+      unsigned char *dst = &out->data[y][region->x0 * channels];
+      for (int x = 0; x < width; x++) {
+        float value = values[x] + 0.5f;
+        dst[x] = (value < 0) ? 0 : (value > 255) ? 255 : (unsigned char)value;
+      }
+    }
+
+    free(sums);
+    free(values);
+  }
+}
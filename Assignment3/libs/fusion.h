@@ -0,0 +1,38 @@
+#include "kernel.h"
+#include "pipeline.h"
+
+#ifndef FUSION_H
+#define FUSION_H
+
+// Iteration fusion of linear kernels
+//
+// A kernel with no negative weights whose weights times the factor sum to
+// at most one maps every image into 0..255, so the clamp never triggers and
+// an iteration is a linear map. n iterations are then one convolution with
+// the n-fold self-convolved kernel of radius n * radius, run after a single
+// halo exchange as deep as that radius.
+//
+// The result is not bit-identical to iterating. Every iteration truncates
+// to whole values, which loses up to one level per iteration, while the
+// fused kernel rounds once. And an iteration sets the cells outside the
+// image back to zero, while the composed kernel lets the values that
+// spread beyond the border in between flow back, within n * radius of the
+// image border. Fusion is therefore only done when asked for.
+//
+// The composed kernel of a rank-1 kernel stays rank-1 and runs as two 1-D
+// passes in single precision, which cost about as much as the iterations
+// they replace, without their halo exchanges. Once the kernel is large
+// enough for FFTs over the tile to be cheaper, see chooseFftSize, and for
+// any other kernel, it is convolved in the frequency domain instead, whose
+// cost hardly grows with the number of iterations fused.
+
+char const * fusionObstacle(kernelPipeline const *pipeline);
+kernelPipeline * fuseKernelPipeline(kernelPipeline const *pipeline, int iterations, int width, int height);
+void applyFusedKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+);
+
+#endif
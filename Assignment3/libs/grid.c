@@ -50,3 +50,33 @@ void createImageGrid(int processes, int* gridWidth, int* gridHeight) {
   *gridHeight = rows;
   *gridWidth = columns;
 }
+
+int calcOffset(int const *split, int index) {
+  /* First row or column of the part with the given index */
+  int offset = 0;
+  for (int i = 0; i < index; i++) {
+    offset += split[i];
+  }
+  return offset;
+}
+
+void calcDisplacements(
+  int const *rowSplit,
+  int const *colSplit,
+  int gridWidth,
+  int gridHeight,
+  int *bytesSplit,
+  int *displ
+) {
+  /* Number of bytes and displacement of every process' sub image */
+  displ[0] = 0;
+  for (int r = 0; r < gridHeight; r++) {
+    for (int c = 0; c < gridWidth; c++) {
+      int rankNumber = r * gridWidth + c;
+      bytesSplit[rankNumber] = rowSplit[r] * colSplit[c];
+      if (rankNumber > 0) {
+        displ[rankNumber] = displ[rankNumber - 1] + bytesSplit[rankNumber - 1];
+      }
+    }
+  }
+}
@@ -5,5 +5,14 @@
 
 int* calcSplit(int processes, int totalCells);
 void createImageGrid(int processes, int* gridWidth, int* gridHeight);
+int calcOffset(int const *split, int index);
+void calcDisplacements(
+  int const *rowSplit,
+  int const *colSplit,
+  int gridWidth,
+  int gridHeight,
+  int *bytesSplit,
+  int *displ
+);
 
 #endif
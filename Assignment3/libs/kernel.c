@@ -1,5 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
 #include "kernel.h"
+#include "fixed.h"
+#include "rank.h"
+#include "morphology.h"
+#include "fusion.h"
+#include "spectral.h"
 
 // Apply convolutional kernel on image data
 void applyKernel(
@@ -20,7 +28,9 @@ void applyKernel(
   int startY = -count;
   int endY = height + count;
 
-
+  // Rows are independent of each other, so they are split across the
+  // OpenMP team of the calling rank
+  #pragma omp parallel for schedule(static)
   for (int y = startY; y < endY; y++) {
     for (int x = startX; x < endX; x++) {
       int aggregate = 0;
@@ -86,3 +96,556 @@ void applyKernel(
     }
   }
 }
+
+// Apply convolutional kernel on a tile with in-line ghost cells.
+//
+// Every tap reads from the same frame, so there is no dispatch on where the
+// value lives. The taps are the outer loops and the pixels of the row the
+// inner one, which leaves a plain multiply-add over contiguous memory that
+// the compiler vectorises. The interleaved channels of a tile are convolved
+// in the same pass, with horizontal taps one pixel of channels apart.
+void applyTileKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  int const *kernel,
+  unsigned int kernelDim,
+  float kernelFactor
+) {
+  int const dim = kernelDim;
+  int const kernelCenter = dim / 2;
+  int const channels = in->channels;
+  int const width = (region->x1 - region->x0) * channels;
+
+  #pragma omp parallel
+  {
+    int *aggregate = malloc(width * sizeof(int));
+
+    #pragma omp for schedule(static)
+    for (int y = region->y0; y < region->y1; y++) {
+      for (int x = 0; x < width; x++) {
+        aggregate[x] = 0;
+      }
+
+      for (int ky = 0; ky < dim; ky++) {
+        int nky = dim - 1 - ky;
+        unsigned char const *row = &in->data[y + ky - kernelCenter][(region->x0 - kernelCenter) * channels];
+        for (int kx = 0; kx < dim; kx++) {
+          int nkx = dim - 1 - kx;
+          int const weight = kernel[nky * dim + nkx];
+          if (weight == 0) {
+            continue;
+          }
+          unsigned char const *src = row + kx * channels;
+          for (int x = 0; x < width; x++) {
+            aggregate[x] += src[x] * weight;
+          }
+        }
+      }
+
+      unsigned char *dst = &out->data[y][region->x0 * channels];
+      for (int x = 0; x < width; x++) {
+        int value = aggregate[x] * kernelFactor;
+        dst[x] = (value > 255) ? 255 : ((value < 0) ? 0 : value);
+      }
+    }
+
+    free(aggregate);
+  }
+}
+
+// Right shift equivalent to multiplying with factor, or -1 if there is none.
+// After clamping, the shift gives the same result as the truncated float
+// multiplication, also for negative aggregates.
+static inline int factorShift(float factor) {
+  for (int shift = 0; shift < 31; shift++) {
+    if (factor == 1.0f / (float)(1u << shift)) {
+      return shift;
+    }
+  }
+  return -1;
+}
+
+static inline unsigned char clampAggregate(int aggregate, int shift, float factor) {
+  int value = (shift >= 0) ? (aggregate >> shift) : (int)(aggregate * factor);
+  return (value > 255) ? 255 : ((value < 0) ? 0 : value);
+}
+
+static void storeAggregate(
+  unsigned char *restrict out,
+  int const *restrict aggregate,
+  int width,
+  int shift,
+  float factor
+) {
+  if (shift >= 0) {
+    for (int x = 0; x < width; x++) {
+      out[x] = clampAggregate(aggregate[x], shift, factor);
+    }
+  } else {
+    for (int x = 0; x < width; x++) {
+      out[x] = clampAggregate(aggregate[x], -1, factor);
+    }
+  }
+}
+
+// Convolve one row with a kernel known at compile time. When inlined with a
+// constant kernel, dimension and channel count, the taps are fully unrolled
+// and zero weights disappear. x0 and x1 are in bytes.
+static inline __attribute__((always_inline)) void convolveRowUnrolled(
+  unsigned char *restrict out,
+  unsigned char **in,
+  int y,
+  int x0,
+  int x1,
+  int const channels,
+  int const *kernel,
+  int const dim,
+  float const factor
+) {
+  int const center = dim / 2;
+  int const shift = factorShift(factor);
+  unsigned char const *rows[dim];
+  for (int ky = 0; ky < dim; ky++) {
+    rows[ky] = in[y + ky - center] - center * channels;
+  }
+  for (int x = x0; x < x1; x++) {
+    int aggregate = 0;
+    for (int ky = 0; ky < dim; ky++) {
+      for (int kx = 0; kx < dim; kx++) {
+        aggregate += rows[ky][x + kx * channels] * kernel[(dim - 1 - ky) * dim + (dim - 1 - kx)];
+      }
+    }
+    out[x] = clampAggregate(aggregate, shift, factor);
+  }
+}
+
+#define SPECIALISED_KERNEL(name, dim)                                          \
+  static void name##Specialised(                                               \
+    imageTile *out,                                                            \
+    imageTile *in,                                                             \
+    tileRegion const *region                                                   \
+  ) {                                                                          \
+    int const channels = in->channels;                                         \
+    int const x0 = region->x0 * channels;                                      \
+    int const x1 = region->x1 * channels;                                      \
+    _Pragma("omp parallel for schedule(static)")                               \
+    for (int y = region->y0; y < region->y1; y++) {                            \
+      if (channels == 1) {                                                     \
+        convolveRowUnrolled(out->data[y], in->data, y, x0, x1, 1,              \
+            name##Kernel, dim, name##KernelFactor);                            \
+      } else {                                                                 \
+        convolveRowUnrolled(out->data[y], in->data, y, x0, x1, channels,       \
+            name##Kernel, dim, name##KernelFactor);                            \
+      }                                                                        \
+    }                                                                          \
+  }
+
+// sobelY, sobelX and gaussian are rank-1 and always run as two 1-D passes
+SPECIALISED_KERNEL(laplacian1, 3)
+SPECIALISED_KERNEL(laplacian2, 3)
+SPECIALISED_KERNEL(laplacian3, 3)
+
+// Gradient magnitude sqrt(gx^2 + gy^2) of sobelY and its transpose, rounded
+// down. It is not a convolution, so it only has a specialised routine.
+static inline unsigned char gradientMagnitude(int gx, int gy) {
+  int square = gx * gx + gy * gy;
+  if (square >= 255 * 255) {
+    return 255;
+  }
+  int root = 0;
+  for (int bit = 128; bit > 0; bit >>= 1) {
+    if ((root + bit) * (root + bit) <= square) {
+      root += bit;
+    }
+  }
+  return root;
+}
+
+static void sobelSpecialised(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region
+) {
+  int const channels = in->channels;
+  int const x0 = region->x0 * channels;
+  int const x1 = region->x1 * channels;
+  #pragma omp parallel for schedule(static)
+  for (int y = region->y0; y < region->y1; y++) {
+    unsigned char const *north = in->data[y - 1];
+    unsigned char const *centre = in->data[y];
+    unsigned char const *south = in->data[y + 1];
+    unsigned char *dst = out->data[y];
+    for (int x = x0; x < x1; x++) {
+      int w = x - channels;
+      int e = x + channels;
+      int gy = (south[w] + 2 * south[x] + south[e]) - (north[w] + 2 * north[x] + north[e]);
+      int gx = (north[e] + 2 * centre[e] + south[e]) - (north[w] + 2 * centre[w] + south[w]);
+      dst[x] = gradientMagnitude(gx, gy);
+    }
+  }
+}
+
+kernelEntry const kernelRegistry[] = {
+  {"sobelY",     sobelYKernel,     3, sobelYKernelFactor,     NULL},
+  {"sobelX",     sobelXKernel,     3, sobelXKernelFactor,     NULL},
+  {"laplacian1", laplacian1Kernel, 3, laplacian1KernelFactor, laplacian1Specialised},
+  {"laplacian2", laplacian2Kernel, 3, laplacian2KernelFactor, laplacian2Specialised},
+  {"laplacian3", laplacian3Kernel, 3, laplacian3KernelFactor, laplacian3Specialised},
+  {"gaussian",   gaussianKernel,   5, gaussianKernelFactor,   NULL},
+  {"sobel",      NULL,             3, 1.0f,                   sobelSpecialised},
+  {NULL, NULL, 0, 0, NULL}
+};
+
+kernelEntry const * findKernel(char const *name) {
+  for (kernelEntry const *entry = kernelRegistry; entry->name != NULL; entry++) {
+    if (strcmp(entry->name, name) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static int greatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    int tmp = a % b;
+    a = b;
+    b = tmp;
+  }
+  return a;
+}
+
+// Split a kernel into the outer product column * row of two integer vectors.
+// Returns 1 if the kernel does not have rank 1.
+static int factoriseKernel(int const *kernel, int dim, int *column, int *row) {
+  // The row vector is the first row which is not zero, divided by the
+  // greatest common divisor of its weights. Every other row has to be an
+  // integer multiple of it.
+  int first = -1;
+  for (int i = 0; i < dim * dim && first < 0; i++) {
+    if (kernel[i] != 0) {
+      first = i / dim;
+    }
+  }
+  if (first < 0) {
+    return 1;
+  }
+
+  int divisor = 0;
+  for (int x = 0; x < dim; x++) {
+    divisor = greatestCommonDivisor(divisor, abs(kernel[first * dim + x]));
+  }
+  int pivot = -1;
+  for (int x = 0; x < dim; x++) {
+    row[x] = kernel[first * dim + x] / divisor;
+    if (pivot < 0 && row[x] != 0) {
+      pivot = x;
+    }
+  }
+
+  for (int y = 0; y < dim; y++) {
+    if (kernel[y * dim + pivot] % row[pivot] != 0) {
+      return 1;
+    }
+    column[y] = kernel[y * dim + pivot] / row[pivot];
+    for (int x = 0; x < dim; x++) {
+      if (column[y] * row[x] != kernel[y * dim + x]) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+kernelPlan * newKernelPlan(kernelEntry const *entry) {
+  kernelPlan *plan = malloc(sizeof(kernelPlan));
+  if (plan == NULL) {
+    return NULL;
+  }
+  int dim = entry->dim;
+  plan->entry = entry;
+  plan->radius = dim / 2;
+  plan->shift = factorShift(entry->factor);
+
+  int *column = malloc(dim * sizeof(int));
+  int *row = malloc(dim * sizeof(int));
+  plan->columnKernel = malloc(dim * sizeof(int));
+  plan->rowKernel = malloc(dim * sizeof(int));
+  if (
+    entry->kernel != NULL &&
+    column != NULL && row != NULL &&
+    plan->columnKernel != NULL && plan->rowKernel != NULL &&
+    factoriseKernel(entry->kernel, dim, column, row) == 0
+  ) {
+    // Flip the vectors like the 2-D kernel is flipped in applyTileKernel
+    for (int i = 0; i < dim; i++) {
+      plan->columnKernel[i] = column[dim - 1 - i];
+      plan->rowKernel[i] = row[dim - 1 - i];
+    }
+  } else {
+    free(plan->columnKernel);
+    free(plan->rowKernel);
+    plan->columnKernel = NULL;
+    plan->rowKernel = NULL;
+  }
+  free(column);
+  free(row);
+  plan->fixedPoint = fixedPointMode(plan, NULL, NULL);
+  plan->box = 0;
+  plan->rankRadius = 0;
+  plan->percentile = 0;
+  plan->morphology = MORPHOLOGY_NONE;
+  plan->radiusX = 0;
+  plan->radiusY = 0;
+  plan->fused = 0;
+  plan->fusedColumn = NULL;
+  plan->fusedRow = NULL;
+  plan->fftSize = 0;
+  plan->fftTable = NULL;
+  plan->fftSpectrum = NULL;
+  return plan;
+}
+
+static kernelEntry const boxEntry = {"box", NULL, 0, 1.0f, NULL};
+
+kernelPlan * newBoxKernelPlan(int radius) {
+  kernelPlan *plan = newKernelPlan(&boxEntry);
+  if (plan == NULL) {
+    return NULL;
+  }
+  plan->radius = radius;
+  plan->box = radius;
+  return plan;
+}
+
+void freeKernelPlan(kernelPlan *plan) {
+  if (plan == NULL) {
+    return;
+  }
+  free(plan->columnKernel);
+  free(plan->rowKernel);
+  free(plan->fusedColumn);
+  free(plan->fusedRow);
+  freeFftTable(plan->fftTable);
+  if (plan->fftSpectrum != NULL) {
+    freeFftBuffer(plan->fftSpectrum);
+  }
+  free(plan);
+}
+
+void printKernelPlan(FILE *out, kernelPlan const *plan) {
+  kernelEntry const *entry = plan->entry;
+  if (plan->fused > 0) {
+    int dim = 2 * plan->radius + 1;
+    if (plan->fftSize > 0) {
+      fprintf(out, "Kernel:      %s x %d fused (%dx%d), FFT %dx%d overlap-save\n",
+          entry->name, plan->fused, dim, dim, plan->fftSize, plan->fftSize);
+    } else {
+      fprintf(out, "Kernel:      %s x %d fused (%dx%d), separable float\n",
+          entry->name, plan->fused, dim, dim);
+    }
+    return;
+  }
+  if (plan->box > 0) {
+    fprintf(out, "Kernel:      box (%dx%d), running sums\n", 2 * plan->box + 1, 2 * plan->box + 1);
+    return;
+  }
+  if (plan->rankRadius > 0) {
+    int dim = 2 * plan->rankRadius + 1;
+    fprintf(out, "Kernel:      percentile %d (%dx%d), column histograms\n",
+        plan->percentile, dim, dim);
+    return;
+  }
+  if (plan->morphology != MORPHOLOGY_NONE) {
+    fprintf(out, "Kernel:      %s (%dx%d), van Herk/Gil-Werman\n", entry->name,
+        2 * plan->radiusX + 1, 2 * plan->radiusY + 1);
+    return;
+  }
+  fprintf(out, "Kernel:      %s (%ux%u)", entry->name, entry->dim, entry->dim);
+  if (plan->rowKernel != NULL) {
+    fprintf(out, ", two 1-D passes");
+  } else if (entry->specialised != NULL && plan->fixedPoint == FIXED_POINT_NONE) {
+    fprintf(out, ", unrolled");
+  }
+  if (plan->shift > 0) {
+    fprintf(out, ", factor as shift by %d", plan->shift);
+  }
+  if (plan->fixedPoint != FIXED_POINT_NONE) {
+    fprintf(out, ", %s16 x %d lanes",
+        (plan->fixedPoint == FIXED_POINT_SIGNED) ? "int" : "uint",
+        fixedPointLanes());
+  }
+  fprintf(out, "\n");
+}
+
+// Number of output rows one thread computes with a buffer of 1-D results
+#define SEPARABLE_CHUNK_ROWS 32
+
+// Apply a rank-1 kernel as a horizontal pass into an integer buffer followed
+// by a vertical pass. Intermediate results are not rounded, so the result is
+// the same as with the 2-D kernel.
+static void applySeparableKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+) {
+  int const dim = plan->entry->dim;
+  int const center = plan->radius;
+  int const channels = in->channels;
+  int const width = (region->x1 - region->x0) * channels;
+  int const height = region->y1 - region->y0;
+  int const chunks = (height + SEPARABLE_CHUNK_ROWS - 1) / SEPARABLE_CHUNK_ROWS;
+
+  #pragma omp parallel
+  {
+    int *rows = malloc((SEPARABLE_CHUNK_ROWS + 2 * center) * width * sizeof(int));
+    int *aggregate = malloc(width * sizeof(int));
+
+    #pragma omp for schedule(static)
+    for (int chunk = 0; chunk < chunks; chunk++) {
+      int y0 = region->y0 + chunk * SEPARABLE_CHUNK_ROWS;
+      int y1 = (y0 + SEPARABLE_CHUNK_ROWS < region->y1) ? y0 + SEPARABLE_CHUNK_ROWS : region->y1;
+
+      // Horizontal pass over every input row of the chunk
+      for (int y = y0 - center; y < y1 + center; y++) {
+        int *dst = &rows[(y - y0 + center) * width];
+        unsigned char const *row = &in->data[y][(region->x0 - center) * channels];
+        for (int x = 0; x < width; x++) {
+          dst[x] = 0;
+        }
+        for (int kx = 0; kx < dim; kx++) {
+          int const weight = plan->rowKernel[kx];
+          if (weight == 0) {
+            continue;
+          }
+          unsigned char const *src = row + kx * channels;
+          for (int x = 0; x < width; x++) {
+            dst[x] += src[x] * weight;
+          }
+        }
+      }
+
+      // Vertical pass
+      for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < width; x++) {
+          aggregate[x] = 0;
+        }
+        for (int ky = 0; ky < dim; ky++) {
+          int const weight = plan->columnKernel[ky];
+          if (weight == 0) {
+            continue;
+          }
+          int const *src = &rows[(y - y0 + ky) * width];
+          for (int x = 0; x < width; x++) {
+            aggregate[x] += src[x] * weight;
+          }
+        }
+        storeAggregate(&out->data[y][region->x0 * channels], aggregate, width,
+            plan->shift, plan->entry->factor);
+      }
+    }
+
+    free(rows);
+    free(aggregate);
+  }
+}
+
+// Mean of the (2 * radius + 1)^2 window, rounded to the nearest value. The
+// sums of the window columns are moved down by adding the row entering the
+// window and subtracting the row leaving it, and the sum of the window is
+// moved right the same way over the column sums. Every thread sweeps a band
+// of rows and only sums the first window of its band from scratch.
+static void applyBoxKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  int radius
+) {
+  int const channels = in->channels;
+  int const span = radius * channels;
+  int const x0 = region->x0 * channels;
+  int const width = (region->x1 - region->x0) * channels;
+  int const area = (2 * radius + 1) * (2 * radius + 1);
+  int const height = region->y1 - region->y0;
+
+  #pragma omp parallel
+  {
+    int const threads = omp_get_num_threads();
+    int const thread = omp_get_thread_num();
+    int const y0 = region->y0 + (int)((long)height * thread / threads);
+    int const y1 = region->y0 + (int)((long)height * (thread + 1) / threads);
+    // Column sums from x0 - span and the window sums from x0, in bytes
+    int *columns = malloc((width + 2 * span) * sizeof(int));
+    int *sums = malloc(width * sizeof(int));
+
+    if (y0 < y1) {
+      for (int x = 0; x < width + 2 * span; x++) {
+        columns[x] = 0;
+      }
+      for (int y = y0 - radius; y <= y0 + radius; y++) {
+        unsigned char const *row = &in->data[y][x0 - span];
+        for (int x = 0; x < width + 2 * span; x++) {
+          columns[x] += row[x];
+        }
+      }
+    }
+
+    for (int y = y0; y < y1; y++) {
+      if (y > y0) {
+        unsigned char const *enter = &in->data[y + radius][x0 - span];
+        unsigned char const *leave = &in->data[y - radius - 1][x0 - span];
+        for (int x = 0; x < width + 2 * span; x++) {
+          columns[x] += enter[x] - leave[x];
+        }
+      }
+
+      for (int c = 0; c < channels && c < width; c++) {
+        int sum = 0;
+        for (int k = 0; k <= 2 * span; k += channels) {
+          sum += columns[c + k];
+        }
+        sums[c] = sum;
+      }
+      for (int x = channels; x < width; x++) {
+        sums[x] = sums[x - channels] + columns[x + 2 * span] - columns[x - channels];
+      }
+
+      unsigned char *dst = &out->data[y][x0];
+      for (int x = 0; x < width; x++) {
+        dst[x] = (sums[x] + area / 2) / area;
+      }
+    }
+
+    free(columns);
+    free(sums);
+  }
+}
+
+void applyKernelPlan(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+) {
+  kernelEntry const *entry = plan->entry;
+  if (plan->fftSize > 0) {
+    applySpectralKernel(out, in, region, plan);
+  } else if (plan->fused > 0) {
+    applyFusedKernel(out, in, region, plan);
+  } else if (plan->box > 0) {
+    applyBoxKernel(out, in, region, plan->box);
+  } else if (plan->rankRadius > 0) {
+    applyRankKernel(out, in, region, NULL, plan);
+  } else if (plan->morphology != MORPHOLOGY_NONE) {
+    applyMorphologyKernel(out, in, region, NULL, plan);
+  } else if (plan->fixedPoint != FIXED_POINT_NONE) {
+    applyFixedPointKernel(out, in, region, plan);
+  } else if (plan->rowKernel != NULL) {
+    applySeparableKernel(out, in, region, plan);
+  } else if (entry->specialised != NULL) {
+    entry->specialised(out, in, region);
+  } else {
+    applyTileKernel(out, in, region, entry->kernel, entry->dim, entry->factor);
+  }
+}
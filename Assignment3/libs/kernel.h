@@ -1,4 +1,7 @@
+#include <stdio.h>
 #include "halo.h"
+#include "tile.h"
+#include "fft.h"
 #ifndef KERNEL_H
 #define KERNEL_H
 
@@ -65,4 +68,86 @@ void applyKernel(
   float kernelFactor
 );
 
+void applyTileKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  int const *kernel,
+  unsigned int kernelDim,
+  float kernelFactor
+);
+
+// Kernel registry
+//
+// Every kernel above is registered under its name, those that are not rank-1
+// together with a routine specialised for their weights and dimension. A
+// kernel plan decides how a kernel is executed on a tile: rank-1 kernels run
+// as two 1-D passes, the other registered kernels use their specialised
+// routine and everything else the generic applyTileKernel. Factors of 1/2^n become shifts.
+// Entries without kernel weights, like the sobel gradient magnitude, are not
+// convolutions and only run their specialised routine. Box filters of any
+// radius are planned with newBoxKernelPlan and run on running sums, so their
+// cost per pixel does not depend on the radius. Rank filters like the median
+// are planned with newRankKernelPlan, see rank.h, erosion and dilation with
+// newMorphologyKernelPlan, see morphology.h. Several iterations of a linear
+// kernel fused into one are planned with fuseKernelPipeline, see fusion.h,
+// and large kernels run through FFTs with setSpectralKernel, see spectral.h.
+
+typedef void (*tileKernelFunction)(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region
+);
+
+typedef struct {
+  char const *name;
+  int const *kernel;
+  unsigned int dim;
+  float factor;
+  tileKernelFunction specialised;
+} kernelEntry;
+
+typedef struct {
+  kernelEntry const *entry;
+  int radius;
+  // Right shift replacing the factor, or -1 if it is no power of two
+  int shift;
+  // Flipped 1-D kernels of a rank-1 kernel, NULL if it is not separable
+  int *columnKernel;
+  int *rowKernel;
+  // Lanes of the 16-bit fixed-point path, see fixed.h
+  int fixedPoint;
+  // Radius of a box filter on running sums, 0 for every other kernel
+  int box;
+  // Radius and percentile of a rank filter on column histograms, see rank.h
+  int rankRadius;
+  int percentile;
+  // Erosion or dilation and the radii of its element, see morphology.h
+  int morphology;
+  int radiusX;
+  int radiusY;
+  // Iterations of a fused kernel and its composed 1-D kernels, see fusion.h
+  int fused;
+  float *fusedColumn;
+  float *fusedRow;
+  // Size of the transforms and spectrum of the kernel, see spectral.h
+  int fftSize;
+  fftTable *fftTable;
+  float *fftSpectrum;
+} kernelPlan;
+
+extern kernelEntry const kernelRegistry[];
+
+kernelEntry const * findKernel(char const *name);
+kernelPlan * newKernelPlan(kernelEntry const *entry);
+kernelPlan * newBoxKernelPlan(int radius);
+void freeKernelPlan(kernelPlan *plan);
+void printKernelPlan(FILE *out, kernelPlan const *plan);
+void applyKernelPlan(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+);
+
 #endif
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "morphology.h"
+
+// Rows of output one thread computes with one buffer of horizontal results,
+// at least the height of the element
+#define MORPHOLOGY_CHUNK_ROWS 32
+
+static kernelEntry const erodeEntry = {"erode", NULL, 0, 1.0f, NULL};
+static kernelEntry const dilateEntry = {"dilate", NULL, 0, 1.0f, NULL};
+
+kernelPlan * newMorphologyKernelPlan(int operation, int radiusX, int radiusY) {
+  kernelPlan *plan = newKernelPlan((operation == MORPHOLOGY_ERODE) ? &erodeEntry : &dilateEntry);
+  if (plan == NULL) {
+    return NULL;
+  }
+  // The halo is as deep in both directions
+  plan->radius = (radiusX > radiusY) ? radiusX : radiusY;
+  plan->morphology = operation;
+  plan->radiusX = radiusX;
+  plan->radiusY = radiusY;
+  return plan;
+}
+
+static inline unsigned char extremum(unsigned char a, unsigned char b, int dilate) {
+  return dilate ? ((a > b) ? a : b) : ((a < b) ? a : b);
+}
+
+// Extremum of every window of length values of line into out, where line
+// holds count + length - 1 values and both lines have a distance of step
+// bytes between values. prefix and suffix hold count + 2 * length values.
+static void extremeWindows(
+  unsigned char *restrict out,
+  unsigned char *restrict prefix,
+  unsigned char *restrict suffix,
+  unsigned char const *restrict line,
+  int count,
+  int length,
+  int step,
+  int dilate,
+  unsigned char pad
+) {
+  int const total = count + length - 1;
+  int const blocks = (total + length - 1) / length;
+  for (int block = 0; block < blocks; block++) {
+    int start = block * length;
+    int end = start + length;
+    prefix[start] = (start < total) ? line[start * step] : pad;
+    for (int i = start + 1; i < end; i++) {
+      prefix[i] = extremum(prefix[i - 1], (i < total) ? line[i * step] : pad, dilate);
+    }
+    suffix[end - 1] = (end - 1 < total) ? line[(end - 1) * step] : pad;
+    for (int i = end - 2; i >= start; i--) {
+      suffix[i] = extremum(suffix[i + 1], (i < total) ? line[i * step] : pad, dilate);
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    out[i * step] = extremum(suffix[i], prefix[i + length - 1], dilate);
+  }
+}
+
+void applyMorphologyKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPlan const *plan
+) {
+  int const dilate = (plan->morphology == MORPHOLOGY_DILATE);
+  unsigned char const pad = dilate ? 0 : 255;
+  int const rx = plan->radiusX;
+  int const ry = plan->radiusY;
+  int const channels = in->channels;
+  int const width = region->x1 - region->x0;
+  int const bytes = width * channels;
+  int const height = region->y1 - region->y0;
+  int const chunkRows = (MORPHOLOGY_CHUNK_ROWS > 2 * ry + 1) ? MORPHOLOGY_CHUNK_ROWS : 2 * ry + 1;
+  int const chunks = (height + chunkRows - 1) / chunkRows;
+
+  // Cells of the frame inside the image
+  int const minX = (limit != NULL) ? limit->x0 : -(int)in->count;
+  int const maxX = (limit != NULL) ? limit->x1 : (int)(in->width + in->count);
+  int const minY = (limit != NULL) ? limit->y0 : -(int)in->count;
+  int const maxY = (limit != NULL) ? limit->y1 : (int)(in->height + in->count);
+
+  #pragma omp parallel
+  {
+    int const lengthX = 2 * rx + 1;
+    int const lengthY = 2 * ry + 1;
+    // Horizontal results of the chunk and their extrema within blocks of
+    // lengthY rows, a padded line and its extrema within blocks
+    unsigned char *rows = malloc((chunkRows + 2 * ry) * bytes);
+    unsigned char *prefixRows = malloc((chunkRows + 2 * ry + lengthY) * bytes);
+    unsigned char *suffixRows = malloc((chunkRows + 2 * ry + lengthY) * bytes);
+    unsigned char *line = malloc((width + 2 * rx) * channels);
+    unsigned char *prefix = malloc(width + 2 * lengthX);
+    unsigned char *suffix = malloc(width + 2 * lengthX);
+
+    #pragma omp for schedule(static)
+    for (int chunk = 0; chunk < chunks; chunk++) {
+      int y0 = region->y0 + chunk * chunkRows;
+      int y1 = (y0 + chunkRows < region->y1) ? y0 + chunkRows : region->y1;
+
+      // Horizontal pass over every input row of the chunk. Rows outside the
+      // image are padding, as are the cells outside it in every row.
+      for (int y = y0 - ry; y < y1 + ry; y++) {
+        unsigned char *dst = &rows[(y - y0 + ry) * bytes];
+        if (y < minY || y >= maxY) {
+          memset(dst, pad, bytes);
+          continue;
+        }
+        for (int x = region->x0 - rx; x < region->x1 + rx; x++) {
+          unsigned char *to = &line[(x - region->x0 + rx) * channels];
+          if (x < minX || x >= maxX) {
+            memset(to, pad, channels);
+          } else {
+            memcpy(to, &in->data[y][x * channels], channels);
+          }
+        }
+        for (int c = 0; c < channels; c++) {
+          extremeWindows(&dst[c], prefix, suffix, &line[c], width, lengthX, channels, dilate, pad);
+        }
+      }
+
+      // Vertical pass on whole rows, so that every step runs along a row
+      int const total = (y1 - y0) + 2 * ry;
+      for (int start = 0; start < total; start += lengthY) {
+        int end = start + lengthY;
+        for (int i = start; i < end; i++) {
+          unsigned char *pre = &prefixRows[i * bytes];
+          if (i >= total) {
+            memset(pre, pad, bytes);
+          } else if (i == start) {
+            memcpy(pre, &rows[i * bytes], bytes);
+          } else {
+            unsigned char const *last = &prefixRows[(i - 1) * bytes];
+            unsigned char const *src = &rows[i * bytes];
+            for (int x = 0; x < bytes; x++) {
+              pre[x] = extremum(last[x], src[x], dilate);
+            }
+          }
+        }
+        for (int i = end - 1; i >= start; i--) {
+          unsigned char *suf = &suffixRows[i * bytes];
+          if (i >= total) {
+            memset(suf, pad, bytes);
+          } else if (i == end - 1 || i + 1 >= total) {
+            memcpy(suf, &rows[i * bytes], bytes);
+          } else {
+            unsigned char const *next = &suffixRows[(i + 1) * bytes];
+            unsigned char const *src = &rows[i * bytes];
+            for (int x = 0; x < bytes; x++) {
+              suf[x] = extremum(next[x], src[x], dilate);
+            }
+          }
+        }
+      }
+      for (int y = y0; y < y1; y++) {
+        unsigned char const *suf = &suffixRows[(y - y0) * bytes];
+        unsigned char const *pre = &prefixRows[(y - y0 + lengthY - 1) * bytes];
+        unsigned char *dst = &out->data[y][region->x0 * channels];
+        for (int x = 0; x < bytes; x++) {
+          dst[x] = extremum(suf[x], pre[x], dilate);
+        }
+      }
+    }
+
+    free(rows);
+    free(prefixRows);
+    free(suffixRows);
+    free(line);
+    free(prefix);
+    free(suffix);
+  }
+}
@@ -0,0 +1,34 @@
+#include "kernel.h"
+
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+// Erosion and dilation with rectangular structuring elements
+//
+// The minimum (erosion) or maximum (dilation) over a (2 * radiusX + 1) x
+// (2 * radiusY + 1) rectangle is separable into a horizontal and a vertical
+// pass. Each pass uses the van Herk/Gil-Werman algorithm: the line is cut
+// into blocks of the window length, and prefix and suffix extrema within
+// every block give the extremum of any window as the combination of one
+// suffix and one prefix value. That is three comparisons per pixel and pass
+// whatever the size of the element.
+//
+// The structuring element never reaches outside the image: erosion pads
+// with 255 and dilation with 0. Which cells are outside is given by limit as
+// in applyKernelPipeline; without a limit every cell of the frame counts as
+// inside.
+
+#define MORPHOLOGY_NONE 0
+#define MORPHOLOGY_ERODE 1
+#define MORPHOLOGY_DILATE 2
+
+kernelPlan * newMorphologyKernelPlan(int operation, int radiusX, int radiusY);
+void applyMorphologyKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPlan const *plan
+);
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "pipeline.h"
+#include "rank.h"
+#include "morphology.h"
+
+// Rows a stage computes with one call, so the call overhead is paid per
+// group of rows instead of per row. Box, rank and morphology filters compute
+// at least as many rows as their window is high, so the first window of a
+// call stays cheap.
+#define PIPELINE_ROWS 8
+
+// Largest radius of a box filter, so that the sum of a window fits an int
+#define MAX_BOX_RADIUS 1024
+// Box filters in the approximation of a Gaussian
+#define GAUSS_BOX_PASSES 3
+
+// Radii of box filters whose variances add up to about sigma^2, so that
+// applying them one after the other approximates a Gaussian. The widths are
+// the two odd numbers around the ideal width, as many of the smaller one as
+// bring the variance closest to sigma^2.
+static void gaussBoxRadii(double sigma, int passes, int *radii) {
+  double variance = 12.0 * sigma * sigma;
+  int lower = 1;
+  while ((double)(lower + 2) * (lower + 2) <= variance / passes + 1) {
+    lower += 2;
+  }
+  double ideal = (passes * (lower * lower + 4.0 * lower + 3.0) - variance) / (4.0 * lower + 4.0);
+  int smaller = (int)(ideal + 0.5);
+  smaller = (smaller < 0) ? 0 : ((smaller > passes) ? passes : smaller);
+  for (int i = 0; i < passes; i++) {
+    radii[i] = (i < smaller) ? lower / 2 : lower / 2 + 1;
+  }
+}
+
+static int appendPlan(kernelPipeline *pipeline, kernelPlan *plan) {
+  if (plan == NULL) {
+    return 1;
+  }
+  pipeline->plans[pipeline->stages++] = plan;
+  pipeline->radius += plan->radius;
+  return 0;
+}
+
+// Radius of a rank filter, or -1 if it is not valid
+static int parseRankRadius(char const *parameter) {
+  char *end;
+  long radius = strtol(parameter, &end, 10);
+  if (end == parameter || *end != '\0' || radius < 1 || radius > MAX_RANK_RADIUS) {
+    return -1;
+  }
+  return radius;
+}
+
+// Radii of a structuring element <radius> or <radiusX>x<radiusY>, returns 1
+// if they are not valid
+static int parseElement(char const *parameter, int *radiusX, int *radiusY) {
+  char *end;
+  long x = strtol(parameter, &end, 10);
+  long y = x;
+  if (end != parameter && *end == 'x') {
+    char const *second = end + 1;
+    y = strtol(second, &end, 10);
+    if (end == second) {
+      return 1;
+    }
+  }
+  if (end == parameter || *end != '\0' || x < 0 || y < 0 || x + y == 0 ||
+      x > MAX_BOX_RADIUS || y > MAX_BOX_RADIUS) {
+    return 1;
+  }
+  *radiusX = x;
+  *radiusY = y;
+  return 0;
+}
+
+// Append the plans of one name of the list: a registered kernel, box:<radius>,
+// gaussbox:<sigma>, median:<radius>, min:<radius>, max:<radius>,
+// percentile:<percent>:<radius>, or erode, dilate, open and close with a
+// :<element>. Returns 1 if the name is not valid.
+static int appendStage(kernelPipeline *pipeline, char *name) {
+  char *parameter = strchr(name, ':');
+  char *end = NULL;
+  if (parameter != NULL) {
+    *parameter++ = '\0';
+  }
+
+  if (parameter != NULL && strcmp(name, "box") == 0) {
+    long radius = strtol(parameter, &end, 10);
+    if (end == parameter || *end != '\0' || radius < 1 || radius > MAX_BOX_RADIUS) {
+      return 1;
+    }
+    return appendPlan(pipeline, newBoxKernelPlan(radius));
+  }
+
+  if (parameter != NULL && strcmp(name, "gaussbox") == 0) {
+    double sigma = strtod(parameter, &end);
+    if (end == parameter || *end != '\0' || !(sigma > 0) || sigma > MAX_BOX_RADIUS / 2) {
+      return 1;
+    }
+    int radii[GAUSS_BOX_PASSES];
+    gaussBoxRadii(sigma, GAUSS_BOX_PASSES, radii);
+    for (int i = 0; i < GAUSS_BOX_PASSES; i++) {
+      // A box of radius 0 does not change the image
+      if (radii[i] > 0 && appendPlan(pipeline, newBoxKernelPlan(radii[i])) != 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // Opening is an erosion followed by a dilation, closing the reverse
+  int first = MORPHOLOGY_NONE;
+  int second = MORPHOLOGY_NONE;
+  if (parameter != NULL && strcmp(name, "erode") == 0) {
+    first = MORPHOLOGY_ERODE;
+  } else if (parameter != NULL && strcmp(name, "dilate") == 0) {
+    first = MORPHOLOGY_DILATE;
+  } else if (parameter != NULL && strcmp(name, "open") == 0) {
+    first = MORPHOLOGY_ERODE;
+    second = MORPHOLOGY_DILATE;
+  } else if (parameter != NULL && strcmp(name, "close") == 0) {
+    first = MORPHOLOGY_DILATE;
+    second = MORPHOLOGY_ERODE;
+  }
+  if (first != MORPHOLOGY_NONE) {
+    int radiusX;
+    int radiusY;
+    if (parseElement(parameter, &radiusX, &radiusY) != 0 ||
+        appendPlan(pipeline, newMorphologyKernelPlan(first, radiusX, radiusY)) != 0) {
+      return 1;
+    }
+    if (second != MORPHOLOGY_NONE) {
+      return appendPlan(pipeline, newMorphologyKernelPlan(second, radiusX, radiusY));
+    }
+    return 0;
+  }
+
+  int percentile = -1;
+  if (parameter != NULL && strcmp(name, "median") == 0) {
+    percentile = 50;
+  } else if (parameter != NULL && strcmp(name, "min") == 0) {
+    percentile = 0;
+  } else if (parameter != NULL && strcmp(name, "max") == 0) {
+    percentile = 100;
+  } else if (parameter != NULL && strcmp(name, "percentile") == 0) {
+    percentile = strtol(parameter, &end, 10);
+    if (end == parameter || *end != ':' || percentile < 0 || percentile > 100) {
+      return 1;
+    }
+    parameter = end + 1;
+  }
+  if (percentile >= 0) {
+    int radius = parseRankRadius(parameter);
+    if (radius < 0) {
+      return 1;
+    }
+    return appendPlan(pipeline, newRankKernelPlan(radius, percentile));
+  }
+
+  kernelEntry const *entry = (parameter == NULL) ? findKernel(name) : NULL;
+  if (entry == NULL) {
+    return 1;
+  }
+  return appendPlan(pipeline, newKernelPlan(entry));
+}
+
+kernelPipeline * newKernelPipeline(char const *names) {
+  kernelPipeline *pipeline = calloc(1, sizeof(kernelPipeline));
+  char *list = malloc(strlen(names) + 1);
+  if (pipeline == NULL || list == NULL) {
+    goto error_exit;
+  }
+  strcpy(list, names);
+
+  int count = 1;
+  for (char const *c = names; *c != '\0'; c++) {
+    count += (*c == ',');
+  }
+  pipeline->plans = calloc(count * GAUSS_BOX_PASSES, sizeof(kernelPlan *));
+  if (pipeline->plans == NULL) {
+    goto error_exit;
+  }
+
+  char *name = list;
+  for (int i = 0; i < count; i++) {
+    char *end = strchr(name, ',');
+    if (end != NULL) {
+      *end = '\0';
+    }
+    if (appendStage(pipeline, name) != 0) {
+      goto error_exit;
+    }
+    name = end + 1;
+  }
+  if (pipeline->stages == 0) {
+    goto error_exit;
+  }
+  free(list);
+  return pipeline;
+
+error_exit:
+  free(list);
+  freeKernelPipeline(pipeline);
+  return NULL;
+}
+
+void freeKernelPipeline(kernelPipeline *pipeline) {
+  if (pipeline == NULL) {
+    return;
+  }
+  if (pipeline->plans != NULL) {
+    for (int s = 0; s < pipeline->stages; s++) {
+      freeKernelPlan(pipeline->plans[s]);
+    }
+  }
+  free(pipeline->plans);
+  free(pipeline);
+}
+
+void printKernelPipeline(FILE *out, kernelPipeline const *pipeline) {
+  if (pipeline->stages > 1) {
+    fprintf(out, "Pipeline:    %d stages in one sweep, halo of %d per iteration\n",
+        pipeline->stages, pipeline->radius);
+  }
+  for (int s = 0; s < pipeline->stages; s++) {
+    printKernelPlan(out, pipeline->plans[s]);
+  }
+}
+
+// Frame for the output of a stage. The rows inside the region of the stage
+// cycle through the slots of a ring, every other row is a row of zeros.
+static imageTile * newStageRing(
+  imageTile const *in,
+  tileRegion const *region,
+  int slots,
+  unsigned char *zeros
+) {
+  imageTile *ring = malloc(sizeof(imageTile));
+  if (ring == NULL) {
+    return NULL;
+  }
+  int const count = in->count;
+  int const offset = count * in->channels;
+  ring->width = in->width;
+  ring->height = in->height;
+  ring->count = count;
+  ring->channels = in->channels;
+  ring->stride = in->stride;
+  ring->rawdata = calloc(slots, in->stride);
+  ring->rows = malloc((in->height + 2 * count) * sizeof(unsigned char *));
+  if (ring->rawdata == NULL || ring->rows == NULL) {
+    free(ring->rawdata);
+    free(ring->rows);
+    free(ring);
+    return NULL;
+  }
+  ring->data = &ring->rows[count];
+  for (int y = -count; y < (int)in->height + count; y++) {
+    if (y >= region->y0 && y < region->y1) {
+      ring->data[y] = &ring->rawdata[((y - region->y0) % slots) * in->stride + offset];
+    } else {
+      ring->data[y] = &zeros[offset];
+    }
+  }
+  return ring;
+}
+
+static void freeStageRing(imageTile *ring) {
+  if (ring == NULL) {
+    return;
+  }
+  free(ring->rawdata);
+  free(ring->rows);
+  free(ring);
+}
+
+// Apply one stage. Rank filters, erosion and dilation are the only stages
+// that have to know where the image ends.
+static void applyStage(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPlan const *plan
+) {
+  if (plan->rankRadius > 0) {
+    applyRankKernel(out, in, region, limit, plan);
+  } else if (plan->morphology != MORPHOLOGY_NONE) {
+    applyMorphologyKernel(out, in, region, limit, plan);
+  } else {
+    applyKernelPlan(out, in, region, plan);
+  }
+}
+
+typedef struct {
+  kernelPipeline const *pipeline;
+  imageTile *in;
+  // Output frame of every stage, the last one is the output tile
+  imageTile **frames;
+  tileRegion const *regions;
+  tileRegion const *limit;
+  // Next row every stage computes and rows computed at once
+  int *next;
+  int rows;
+} pipelineSweep;
+
+// Compute the rows of stage s up to row last, after the rows of the stage
+// before that they read
+static void advanceStage(pipelineSweep *sweep, int s, int last) {
+  tileRegion const *region = &sweep->regions[s];
+  kernelPlan const *plan = sweep->pipeline->plans[s];
+  if (last >= region->y1) {
+    last = region->y1 - 1;
+  }
+  while (sweep->next[s] <= last) {
+    int end = sweep->next[s] + sweep->rows - 1;
+    if (end > last) {
+      end = last;
+    }
+    if (s > 0) {
+      advanceStage(sweep, s - 1, end + plan->radius);
+    }
+    tileRegion rows = {region->x0, region->x1, sweep->next[s], end + 1};
+    applyStage(sweep->frames[s], (s > 0) ? sweep->frames[s - 1] : sweep->in, &rows, sweep->limit, plan);
+    sweep->next[s] = end + 1;
+  }
+}
+
+// Apply all stages of the pipeline to region. Stage s computes the region
+// grown by the radii of the later stages, but never beyond limit.
+void applyKernelPipeline(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPipeline const *pipeline
+) {
+  int const stages = pipeline->stages;
+  if (stages == 1) {
+    applyStage(out, in, region, limit, pipeline->plans[0]);
+    return;
+  }
+
+  int rows = PIPELINE_ROWS;
+  for (int s = 0; s < stages; s++) {
+    kernelPlan const *plan = pipeline->plans[s];
+    if ((plan->box > 0 || plan->rankRadius > 0 || plan->morphology != MORPHOLOGY_NONE) &&
+        2 * plan->radius + 1 > rows) {
+      rows = 2 * plan->radius + 1;
+    }
+  }
+  int later[stages];
+  tileRegion regions[stages];
+  later[stages - 1] = 0;
+  regions[stages - 1] = *region;
+  for (int s = stages - 2; s >= 0; s--) {
+    later[s] = later[s + 1] + pipeline->plans[s + 1]->radius;
+    int x0 = region->x0 - later[s];
+    int x1 = region->x1 + later[s];
+    int y0 = region->y0 - later[s];
+    int y1 = region->y1 + later[s];
+    regions[s].x0 = (x0 > limit->x0) ? x0 : limit->x0;
+    regions[s].x1 = (x1 < limit->x1) ? x1 : limit->x1;
+    regions[s].y0 = (y0 > limit->y0) ? y0 : limit->y0;
+    regions[s].y1 = (y1 < limit->y1) ? y1 : limit->y1;
+  }
+
+  // Every thread sweeps a band of rows with its own rings. The rows near
+  // the band borders of the intermediate stages are computed twice.
+  #pragma omp parallel
+  {
+    int const threads = omp_get_num_threads();
+    int const thread = omp_get_thread_num();
+    int const height = region->y1 - region->y0;
+    int const by0 = region->y0 + (int)((long)height * thread / threads);
+    int const by1 = region->y0 + (int)((long)height * (thread + 1) / threads);
+
+    unsigned char *zeros = calloc(1, in->stride);
+    imageTile *frames[stages];
+    int next[stages];
+    for (int s = 0; s < stages - 1; s++) {
+      int slots = 2 * pipeline->plans[s + 1]->radius + rows;
+      frames[s] = newStageRing(in, &regions[s], slots, zeros);
+      next[s] = (by0 - later[s] > regions[s].y0) ? by0 - later[s] : regions[s].y0;
+    }
+    frames[stages - 1] = out;
+    next[stages - 1] = by0;
+
+    pipelineSweep sweep = {pipeline, in, frames, regions, limit, next, rows};
+    if (by0 < by1) {
+      advanceStage(&sweep, stages - 1, by1 - 1);
+    }
+
+    for (int s = 0; s < stages - 1; s++) {
+      freeStageRing(frames[s]);
+    }
+    free(zeros);
+  }
+}
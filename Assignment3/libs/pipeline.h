@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include "kernel.h"
+#include "tile.h"
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Fused kernel pipelines
+//
+// A pipeline applies several kernels one after the other in every
+// iteration, e.g. gaussian,laplacian1. Instead of writing the whole tile
+// after every kernel, the stages run as one sweep down the tile: every stage
+// keeps only the rows the next stage still reads in a small ring, and each
+// row is computed when the next stage first needs it. The halo of one
+// iteration is the sum of the radii of all stages.
+//
+// Besides the registered kernels, box:<radius> is the mean over a square
+// window on running sums and gaussbox:<sigma> expands into three box stages
+// approximating a Gaussian. median, min, max and percentile:<percent> with a
+// :<radius> are rank filters. erode, dilate, open and close take a
+// rectangular element :<radius> or :<radiusX>x<radiusY>.
+//
+// Outside the image every stage reads zeros, like a separate pass over a
+// zero padded image would, except rank filters, erosion and dilation, whose
+// windows leave those cells out. limit is the part of the frame where the
+// intermediate rows hold real cells, i.e. the image and ghost cells shared
+// with a neighbour.
+
+typedef struct {
+  int stages;
+  kernelPlan **plans;
+  // Sum of the radii of all stages
+  int radius;
+} kernelPipeline;
+
+kernelPipeline * newKernelPipeline(char const *names);
+void freeKernelPipeline(kernelPipeline *pipeline);
+void printKernelPipeline(FILE *out, kernelPipeline const *pipeline);
+void applyKernelPipeline(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPipeline const *pipeline
+);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "rank.h"
+
+#define FINE_BINS 256
+#define COARSE_BINS 16
+#define COARSE_SHIFT 4
+
+static kernelEntry const rankEntry = {"rank", NULL, 0, 1.0f, NULL};
+
+// Plan of the filter picking the percentile of the window, so 0 is the
+// minimum, 50 the median and 100 the maximum
+kernelPlan * newRankKernelPlan(int radius, int percentile) {
+  kernelPlan *plan = newKernelPlan(&rankEntry);
+  if (plan == NULL) {
+    return NULL;
+  }
+  plan->radius = radius;
+  plan->rankRadius = radius;
+  plan->percentile = percentile;
+  return plan;
+}
+
+typedef struct {
+  uint16_t fine[FINE_BINS];
+  uint16_t coarse[COARSE_BINS];
+} histogram;
+
+static inline void addValue(histogram *h, unsigned char value) {
+  h->fine[value]++;
+  h->coarse[value >> COARSE_SHIFT]++;
+}
+
+static inline void removeValue(histogram *h, unsigned char value) {
+  h->fine[value]--;
+  h->coarse[value >> COARSE_SHIFT]--;
+}
+
+static inline void addHistogram(histogram *restrict to, histogram const *restrict from) {
+  #pragma omp simd
+  for (int i = 0; i < FINE_BINS; i++) {
+    to->fine[i] += from->fine[i];
+  }
+  #pragma omp simd
+  for (int i = 0; i < COARSE_BINS; i++) {
+    to->coarse[i] += from->coarse[i];
+  }
+}
+
+// to += add - sub in one pass
+static inline void slideHistogram(
+  histogram *restrict to,
+  histogram const *restrict add,
+  histogram const *restrict sub
+) {
+  #pragma omp simd
+  for (int i = 0; i < FINE_BINS; i++) {
+    to->fine[i] += add->fine[i] - sub->fine[i];
+  }
+  #pragma omp simd
+  for (int i = 0; i < COARSE_BINS; i++) {
+    to->coarse[i] += add->coarse[i] - sub->coarse[i];
+  }
+}
+
+// Value at position rank of the values counted in h
+static inline unsigned char findRank(histogram const *h, int rank) {
+  int bin = 0;
+  while (h->coarse[bin] <= rank) {
+    rank -= h->coarse[bin];
+    bin++;
+  }
+  int value = bin << COARSE_SHIFT;
+  while (h->fine[value] <= rank) {
+    rank -= h->fine[value];
+    value++;
+  }
+  return value;
+}
+
+// Cells of the window around c inside [low, high) along one axis
+static inline int insideCount(int c, int radius, int low, int high) {
+  int first = (c - radius > low) ? c - radius : low;
+  int last = (c + radius < high - 1) ? c + radius : high - 1;
+  return last - first + 1;
+}
+
+void applyRankKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPlan const *plan
+) {
+  int const radius = plan->rankRadius;
+  int const percentile = plan->percentile;
+  int const channels = in->channels;
+  int const span = radius * channels;
+  int const x0 = region->x0 * channels;
+  int const width = (region->x1 - region->x0) * channels;
+  int const height = region->y1 - region->y0;
+
+  // Cells of the frame inside the image
+  int const minX = (limit != NULL) ? limit->x0 : -(int)in->count;
+  int const maxX = (limit != NULL) ? limit->x1 : (int)(in->width + in->count);
+  int const minY = (limit != NULL) ? limit->y0 : -(int)in->count;
+  int const maxY = (limit != NULL) ? limit->y1 : (int)(in->height + in->count);
+  // Column histograms from x0 - span in bytes, of which those from first to
+  // last count cells inside the image
+  int const columnCount = width + 2 * span;
+  int const first = ((minX - region->x0 + radius > 0) ? minX - region->x0 + radius : 0) * channels;
+  int const last = ((maxX - region->x0 + radius) * channels < columnCount) ?
+      (maxX - region->x0 + radius) * channels : columnCount;
+
+  #pragma omp parallel
+  {
+    int const threads = omp_get_num_threads();
+    int const thread = omp_get_thread_num();
+    int const y0 = region->y0 + (int)((long)height * thread / threads);
+    int const y1 = region->y0 + (int)((long)height * (thread + 1) / threads);
+    histogram *columns = calloc(columnCount, sizeof(histogram));
+    histogram window;
+
+    if (columns == NULL) {
+      // Without memory for the column histograms every window is counted
+      // from the tile itself
+      for (int y = y0; y < y1; y++) {
+        unsigned char *dst = &out->data[y][x0];
+        int const rows = insideCount(y, radius, minY, maxY);
+        for (int x = 0; x < width; x++) {
+          int const px = region->x0 + x / channels;
+          int const cells = rows * insideCount(px, radius, minX, maxX);
+          memset(&window, 0, sizeof(histogram));
+          for (int ky = -radius; ky <= radius; ky++) {
+            if (y + ky < minY || y + ky >= maxY) {
+              continue;
+            }
+            unsigned char const *row = &in->data[y + ky][x0 + x];
+            for (int k = -radius; k <= radius; k++) {
+              if (px + k >= minX && px + k < maxX) {
+                addValue(&window, row[k * channels]);
+              }
+            }
+          }
+          dst[x] = findRank(&window, percentile * (cells - 1) / 100);
+        }
+      }
+    } else {
+      if (y0 < y1) {
+        for (int y = y0 - radius; y <= y0 + radius; y++) {
+          if (y < minY || y >= maxY) {
+            continue;
+          }
+          unsigned char const *row = &in->data[y][x0 - span];
+          for (int x = first; x < last; x++) {
+            addValue(&columns[x], row[x]);
+          }
+        }
+      }
+
+      for (int y = y0; y < y1; y++) {
+        if (y > y0) {
+          if (y - radius - 1 >= minY && y - radius - 1 < maxY) {
+            unsigned char const *leave = &in->data[y - radius - 1][x0 - span];
+            for (int x = first; x < last; x++) {
+              removeValue(&columns[x], leave[x]);
+            }
+          }
+          if (y + radius >= minY && y + radius < maxY) {
+            unsigned char const *enter = &in->data[y + radius][x0 - span];
+            for (int x = first; x < last; x++) {
+              addValue(&columns[x], enter[x]);
+            }
+          }
+        }
+
+        // The window holds the cells inside the image only, so the rank is
+        // taken among as many cells as it holds
+        unsigned char *dst = &out->data[y][x0];
+        int const rows = insideCount(y, radius, minY, maxY);
+        for (int c = 0; c < channels && c < width; c++) {
+          memset(&window, 0, sizeof(histogram));
+          for (int k = 0; k <= 2 * span; k += channels) {
+            addHistogram(&window, &columns[c + k]);
+          }
+          for (int x = c; x < width; x += channels) {
+            if (x > c) {
+              slideHistogram(&window, &columns[x + 2 * span], &columns[x - channels]);
+            }
+            int const cells = rows * insideCount(region->x0 + x / channels, radius, minX, maxX);
+            dst[x] = findRank(&window, percentile * (cells - 1) / 100);
+          }
+        }
+      }
+    }
+
+    free(columns);
+  }
+}
@@ -0,0 +1,37 @@
+#include "kernel.h"
+
+#ifndef RANK_H
+#define RANK_H
+
+// Rank filters with constant cost per pixel
+//
+// A rank filter picks the value at position rank of the sorted window, e.g.
+// the median, the minimum (rank 0) or the maximum. Following Perreault and
+// Hebert, every column of the band keeps a histogram of the 2 * radius + 1
+// cells above and below it, which moves down a row by removing the cell
+// leaving and adding the cell entering. The window histogram of a pixel is
+// the sum of its column histograms and moves right by adding one column and
+// subtracting another, which are 256 lane-wise 16-bit operations the
+// compiler vectorises. A second level of 16 coarse bins finds the rank in at
+// most 32 steps. No step depends on the radius except summing the first
+// window of a row.
+//
+// Like erosion and dilation, the window never reaches outside the image:
+// cells outside it are left out of the column histograms and the rank is
+// taken among the cells of the window inside it. Which cells are outside is
+// given by limit as in applyKernelPipeline; without a limit every cell of the
+// frame counts as inside.
+
+// Counts are 16 bits wide, so the window has to hold less than 2^16 cells
+#define MAX_RANK_RADIUS 127
+
+kernelPlan * newRankKernelPlan(int radius, int percentile);
+void applyRankKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  tileRegion const *limit,
+  kernelPlan const *plan
+);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include "shared.h"
+
+// Bytes in front of the frames: current index, width, height, count and
+// channels, padded to a cache line
+#define SHARED_HEADER 64
+
+static size_t alignFrame(size_t bytes) {
+  return (bytes + 63) / 64 * 64;
+}
+
+// Node rank of a rank of comm, or MPI_UNDEFINED if it is on another node
+static int nodeRankOf(int rank, MPI_Comm comm, MPI_Comm node) {
+  if (rank == MPI_PROC_NULL) {
+    return MPI_UNDEFINED;
+  }
+  MPI_Group group;
+  MPI_Group nodeGroup;
+  MPI_Comm_group(comm, &group);
+  MPI_Comm_group(node, &nodeGroup);
+  int nodeRank;
+  MPI_Group_translate_ranks(group, 1, &rank, nodeGroup, &nodeRank);
+  MPI_Group_free(&group);
+  MPI_Group_free(&nodeGroup);
+  return nodeRank;
+}
+
+// Collective over the communicator of neighbours. The frames start zeroed,
+// like newImageTile.
+sharedTiles * newSharedTiles(
+  int width,
+  int height,
+  int count,
+  int channels,
+  tileExchange const *neighbours
+) {
+  MPI_Comm comm = neighbours->comm;
+  sharedTiles *shared = calloc(1, sizeof(sharedTiles));
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &shared->node);
+
+  // Frames of different ranks do not have to be contiguous, which lets
+  // every rank place its own frames in its local memory
+  MPI_Info info;
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "alloc_shared_noncontig", "true");
+  size_t frameBytes = alignFrame(imageTileBytes(width, height, count, channels));
+  unsigned char *base;
+  MPI_Win_allocate_shared(SHARED_HEADER + 2 * frameBytes, 1, info, shared->node, &base, &shared->window);
+  MPI_Info_free(&info);
+  memset(base, 0, SHARED_HEADER + 2 * frameBytes);
+
+  int *header = (int *)base;
+  header[0] = 0;
+  header[1] = width;
+  header[2] = height;
+  header[3] = count;
+  header[4] = channels;
+  shared->current = header;
+  for (int i = 0; i < 2; i++) {
+    shared->frames[i] = newImageTileView(base + SHARED_HEADER + i * frameBytes, width, height, count, channels);
+  }
+
+  // Passive target epoch for the whole lifetime of the window, the frames
+  // are synchronised with MPI_Win_sync and node barriers
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, shared->window);
+  MPI_Win_sync(shared->window);
+  MPI_Barrier(shared->node);
+  MPI_Win_sync(shared->window);
+
+  int ranks[SHARED_NEIGHBOURS] = {
+    neighbours->north, neighbours->south, neighbours->east, neighbours->west
+  };
+  int remote[SHARED_NEIGHBOURS];
+  for (int i = 0; i < SHARED_NEIGHBOURS; i++) {
+    int nodeRank = nodeRankOf(ranks[i], comm, shared->node);
+    remote[i] = ranks[i];
+    if (nodeRank == MPI_UNDEFINED) {
+      continue;
+    }
+    MPI_Aint size;
+    int unit;
+    unsigned char *theirs;
+    MPI_Win_shared_query(shared->window, nodeRank, &size, &unit, &theirs);
+    int *theirHeader = (int *)theirs;
+    size_t theirBytes = alignFrame(imageTileBytes(theirHeader[1], theirHeader[2], theirHeader[3], theirHeader[4]));
+    shared->neighbourCurrent[i] = theirHeader;
+    for (int f = 0; f < 2; f++) {
+      shared->neighbourFrames[i][f] = newImageTileView(
+          theirs + SHARED_HEADER + f * theirBytes,
+          theirHeader[1], theirHeader[2], theirHeader[3], theirHeader[4]
+      );
+    }
+    remote[i] = MPI_PROC_NULL;
+    shared->local++;
+  }
+
+  shared->remote = newTileExchange(
+      shared->frames[0],
+      remote[SHARED_NORTH],
+      remote[SHARED_SOUTH],
+      remote[SHARED_EAST],
+      remote[SHARED_WEST],
+      comm
+  );
+  return shared;
+}
+
+// Move a pair of tiles into a new window. The frame of tile is copied, ghost
+// cells included, and both tiles are freed and replaced by the frames.
+sharedTiles * shareImageTiles(
+  imageTile **tile,
+  imageTile **processTile,
+  tileExchange const *neighbours
+) {
+  imageTile *from = *tile;
+  sharedTiles *shared = newSharedTiles(from->width, from->height, from->count, from->channels, neighbours);
+  memcpy(shared->frames[0]->rawdata, from->rawdata,
+      imageTileBytes(from->width, from->height, from->count, from->channels));
+  freeImageTile(*tile);
+  freeImageTile(*processTile);
+  *tile = shared->frames[0];
+  *processTile = shared->frames[1];
+  return shared;
+}
+
+// Collective over the node
+void freeSharedTiles(sharedTiles *shared) {
+  if (shared == NULL) {
+    return;
+  }
+  MPI_Barrier(shared->node);
+  for (int i = 0; i < SHARED_NEIGHBOURS; i++) {
+    freeImageTileView(shared->neighbourFrames[i][0]);
+    freeImageTileView(shared->neighbourFrames[i][1]);
+  }
+  freeImageTileView(shared->frames[0]);
+  freeImageTileView(shared->frames[1]);
+  freeTileExchange(shared->remote);
+  MPI_Win_unlock_all(shared->window);
+  MPI_Win_free(&shared->window);
+  MPI_Comm_free(&shared->node);
+  free(shared);
+}
+
+// Current tile of a neighbour on the node
+static imageTile * neighbourTile(sharedTiles *shared, int neighbour) {
+  return shared->neighbourFrames[neighbour][*shared->neighbourCurrent[neighbour]];
+}
+
+static void nodeBarrier(sharedTiles *shared) {
+  MPI_Win_sync(shared->window);
+  MPI_Barrier(shared->node);
+  MPI_Win_sync(shared->window);
+}
+
+// Fill the halo of tile, which has to be one of the two frames of shared
+void exchangeSharedHalo(sharedTiles *shared, imageTile *tile) {
+  int const count = tile->count;
+  int const width = tile->width;
+  int const height = tile->height;
+  int const channels = tile->channels;
+  int const side = count * channels;
+  int const rowBytes = count * tile->stride;
+
+  // Every rank on the node has finished computing its current tile
+  *shared->current = (tile == shared->frames[0]) ? 0 : 1;
+  nodeBarrier(shared);
+
+  exchangeTileColumns(tile, shared->remote);
+  if (shared->neighbourCurrent[SHARED_WEST] != NULL) {
+    imageTile *west = neighbourTile(shared, SHARED_WEST);
+    for (int y = 0; y < height; y++) {
+      memcpy(&tile->data[y][-side], &west->data[y][(west->width - count) * channels], side);
+    }
+  }
+  if (shared->neighbourCurrent[SHARED_EAST] != NULL) {
+    imageTile *east = neighbourTile(shared, SHARED_EAST);
+    for (int y = 0; y < height; y++) {
+      memcpy(&tile->data[y][width * channels], &east->data[y][0], side);
+    }
+  }
+
+  // The east and west ghosts of the neighbours are complete, so the rows
+  // copied next include the corners
+  nodeBarrier(shared);
+
+  exchangeTileRows(tile, shared->remote);
+  if (shared->neighbourCurrent[SHARED_NORTH] != NULL) {
+    imageTile *north = neighbourTile(shared, SHARED_NORTH);
+    memcpy(&tile->data[-count][-side], &north->data[north->height - count][-side], rowBytes);
+  }
+  if (shared->neighbourCurrent[SHARED_SOUTH] != NULL) {
+    imageTile *south = neighbourTile(shared, SHARED_SOUTH);
+    memcpy(&tile->data[height][-side], &south->data[0][-side], rowBytes);
+  }
+
+  // Neighbours may compute into either frame before the next exchange, so
+  // nobody starts before every copy out of its frames is done
+  nodeBarrier(shared);
+}
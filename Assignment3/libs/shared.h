@@ -0,0 +1,56 @@
+#include <mpi.h>
+#include "tile.h"
+
+#ifndef SHARED_H
+#define SHARED_H
+
+// Shared-memory halo exchange
+//
+// The ranks of a node allocate both frames of their tile in one window of
+// MPI_Win_allocate_shared on the node communicator. A rank publishes which
+// of its frames holds the current tile, and neighbours on the same node copy
+// their ghost cells straight out of that frame. Only neighbours on other
+// nodes exchange messages. The exchange runs in the same two phases as
+// exchangeTileHalo, east/west and then north/south with the corners, between
+// node barriers that make sure the frames read are complete and that nobody
+// writes a frame while it is being read.
+
+// Order of the neighbours in sharedTiles
+enum {
+  SHARED_NORTH,
+  SHARED_SOUTH,
+  SHARED_EAST,
+  SHARED_WEST,
+  SHARED_NEIGHBOURS
+};
+
+typedef struct {
+  MPI_Comm node;
+  MPI_Win window;
+  // Index of the frame holding the current tile, in the window
+  int *current;
+  imageTile *frames[2];
+  // Frames and current index of neighbours on the node, NULL for the others
+  int *neighbourCurrent[SHARED_NEIGHBOURS];
+  imageTile *neighbourFrames[SHARED_NEIGHBOURS][2];
+  // Exchange with the neighbours on other nodes only
+  tileExchange *remote;
+  int local;
+} sharedTiles;
+
+sharedTiles * newSharedTiles(
+  int width,
+  int height,
+  int count,
+  int channels,
+  tileExchange const *neighbours
+);
+sharedTiles * shareImageTiles(
+  imageTile **tile,
+  imageTile **processTile,
+  tileExchange const *neighbours
+);
+void freeSharedTiles(sharedTiles *shared);
+void exchangeSharedHalo(sharedTiles *shared, imageTile *tile);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include "spectral.h"
+
+int setSpectralKernel(kernelPlan *plan, double const *weights, int dim, int size) {
+  fftTable *table = newFftTable(size);
+  float *spectrum = newFftBuffer(size);
+  float *scratch = newFftBuffer(size);
+  if (table == NULL || spectrum == NULL || scratch == NULL) {
+    freeFftTable(table);
+    freeFftBuffer(spectrum);
+    freeFftBuffer(scratch);
+    return 1;
+  }
+
+  // The transforms convolve, so the weights are flipped back. The scale of
+  // the inverse transform is folded into the spectrum.
+  float const scale = 1.0f / ((float)size * size);
+  for (int i = 0; i < 2 * size * size; i++) {
+    spectrum[i] = 0;
+  }
+  for (int ky = 0; ky < dim; ky++) {
+    for (int kx = 0; kx < dim; kx++) {
+      spectrum[2 * (ky * size + kx)] = weights[(dim - 1 - ky) * dim + (dim - 1 - kx)] * scale;
+    }
+  }
+  fft2d(spectrum, scratch, table, 0);
+  freeFftBuffer(scratch);
+
+  plan->fftSize = size;
+  plan->fftTable = table;
+  plan->fftSpectrum = spectrum;
+  return 0;
+}
+
+// Every block of every channel is one job, and two jobs share a transform as
+// its real and imaginary part
+void applySpectralKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+) {
+  int const size = plan->fftSize;
+  int const radius = plan->radius;
+  int const dim = 2 * radius + 1;
+  int const block = size - dim + 1;
+  int const channels = in->channels;
+  int const blocksX = (region->x1 - region->x0 + block - 1) / block;
+  int const blocksY = (region->y1 - region->y0 + block - 1) / block;
+  int const jobs = blocksX * blocksY * channels;
+  // Input beyond this is only read by outputs outside the region
+  int const endX = region->x1 + radius;
+  int const endY = region->y1 + radius;
+  float const *spectrum = plan->fftSpectrum;
+
+  #pragma omp parallel
+  {
+    float *data = newFftBuffer(size);
+    float *scratch = newFftBuffer(size);
+
+    #pragma omp for schedule(dynamic)
+    for (int pair = 0; pair < (jobs + 1) / 2; pair++) {
+      for (int part = 0; part < 2; part++) {
+        int job = 2 * pair + part;
+        int c = job % channels;
+        int x0 = region->x0 + (job / channels) % blocksX * block - radius;
+        int y0 = region->y0 + (job / channels) / blocksX * block - radius;
+        for (int j = 0; j < size; j++) {
+          float *line = &data[2 * j * size + part];
+          int y = y0 + j;
+          if (job >= jobs || y >= endY) {
+            for (int i = 0; i < size; i++) {
+              line[2 * i] = 0;
+            }
+            continue;
+          }
+          unsigned char const *row = in->data[y];
+          int count = (endX - x0 < size) ? endX - x0 : size;
+          for (int i = 0; i < count; i++) {
+            line[2 * i] = row[(x0 + i) * channels + c];
+          }
+          for (int i = count; i < size; i++) {
+            line[2 * i] = 0;
+          }
+        }
+      }
+
+      fft2d(data, scratch, plan->fftTable, 0);
+      for (int i = 0; i < size * size; i++) {
+        float re = data[2 * i] * spectrum[2 * i] - data[2 * i + 1] * spectrum[2 * i + 1];
+        float im = data[2 * i] * spectrum[2 * i + 1] + data[2 * i + 1] * spectrum[2 * i];
+        data[2 * i] = re;
+        data[2 * i + 1] = im;
+      }
+      fft2d(data, scratch, plan->fftTable, 1);
+
+      // The first dim - 1 rows and columns wrapped around
+      for (int part = 0; part < 2 && 2 * pair + part < jobs; part++) {
+        int job = 2 * pair + part;
+        int c = job % channels;
+        int x0 = region->x0 + (job / channels) % blocksX * block;
+        int y0 = region->y0 + (job / channels) / blocksX * block;
+        int width = (region->x1 - x0 < block) ? region->x1 - x0 : block;
+        int height = (region->y1 - y0 < block) ? region->y1 - y0 : block;
+        for (int j = 0; j < height; j++) {
+          float const *line = &data[2 * (j + dim - 1) * size + part];
+          unsigned char *dst = out->data[y0 + j];
+          for (int i = 0; i < width; i++) {
+            float value = line[2 * (i + dim - 1)] + 0.5f;
+            dst[(x0 + i) * channels + c] = (value < 0) ? 0 : (value > 255) ? 255 : (unsigned char)value;
+          }
+        }
+      }
+    }
+
+    freeFftBuffer(data);
+    freeFftBuffer(scratch);
+  }
+}
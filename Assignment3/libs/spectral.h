@@ -0,0 +1,27 @@
+#include "kernel.h"
+
+#ifndef SPECTRAL_H
+#define SPECTRAL_H
+
+// Convolution in the frequency domain
+//
+// setSpectralKernel caches the spectrum of a dim x dim kernel for
+// transforms of the given size in the plan, and applySpectralKernel then
+// convolves by overlap-save as described in fft.h. The weights are in the
+// order applyTileKernel reads them after flipping, i.e. weights[ky * dim +
+// kx] multiplies the input at (y + ky - radius, x + kx - radius). Results
+// are rounded to the nearest value and clamped to 0..255.
+//
+// The cost per pixel only depends on the size of the transforms, which
+// chooseFftSize picks for the kernel and the tile, so large kernels cost
+// little more than small ones.
+
+int setSpectralKernel(kernelPlan *plan, double const *weights, int dim, int size);
+void applySpectralKernel(
+  imageTile *out,
+  imageTile *in,
+  tileRegion const *region,
+  kernelPlan const *plan
+);
+
+#endif
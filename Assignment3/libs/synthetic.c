@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include "synthetic.h"
+
+char const *syntheticPatterns[SYNTHETIC_PATTERNS] = {"noise", "gradient", "checker"};
+
+static uint32_t hashPosition(uint32_t seed, uint32_t x, uint32_t y) {
+  uint32_t h = seed * 0x9e3779b9u ^ x * 0x85ebca6bu ^ y * 0xc2b2ae35u;
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return h;
+}
+
+// splitmix64 finaliser
+static uint64_t mix64(uint64_t v) {
+  v += 0x9e3779b97f4a7c15ull;
+  v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull;
+  v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+  return v ^ (v >> 31);
+}
+
+// <width>x<height>[:<pattern>], returns 1 if the specification is invalid
+int parseSyntheticImage(char const *spec, int *width, int *height, int *pattern) {
+  int length = 0;
+  if (sscanf(spec, "%dx%d%n", width, height, &length) != 2 || *width < 1 || *height < 1) {
+    return 1;
+  }
+  *pattern = SYNTHETIC_NOISE;
+  if (spec[length] == '\0') {
+    return 0;
+  }
+  if (spec[length] != ':') {
+    return 1;
+  }
+  for (int p = 0; p < SYNTHETIC_PATTERNS; p++) {
+    if (strcmp(&spec[length + 1], syntheticPatterns[p]) == 0) {
+      *pattern = p;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static pixel syntheticPixel(int pattern, uint32_t seed, int x, int y, int imageWidth, int imageHeight) {
+  pixel p;
+  switch (pattern) {
+    case SYNTHETIC_GRADIENT:
+      p.b = (imageWidth > 1) ? (long)x * 255 / (imageWidth - 1) : 0;
+      p.g = (imageHeight > 1) ? (long)y * 255 / (imageHeight - 1) : 0;
+      p.r = (imageWidth + imageHeight > 2) ? (long)(x + y) * 255 / (imageWidth + imageHeight - 2) : 0;
+      break;
+    case SYNTHETIC_CHECKER: {
+      unsigned char value = ((x / SYNTHETIC_CHECKER_SIZE + y / SYNTHETIC_CHECKER_SIZE) & 1) ? 255 : 0;
+      p.b = value;
+      p.g = value;
+      p.r = value;
+      break;
+    }
+    default: {
+      uint32_t h = hashPosition(seed, x, y);
+      p.b = h;
+      p.g = h >> 8;
+      p.r = h >> 16;
+      break;
+    }
+  }
+  return p;
+}
+
+// Fill the tile at x0, y0 of the image
+void generateSyntheticTile(
+  bmpImageChannel *tile,
+  int channels,
+  int pattern,
+  uint32_t seed,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight
+) {
+  int width = tile->width / channels;
+  #pragma omp parallel for schedule(static)
+  for (int y = 0; y < (int)tile->height; y++) {
+    for (int x = 0; x < width; x++) {
+      pixel p = syntheticPixel(pattern, seed, x0 + x, y0 + y, imageWidth, imageHeight);
+      if (channels == 1) {
+        tile->data[y][x] = extractAverage(p);
+      } else {
+        memcpy(&tile->data[y][x * channels], &p, sizeof(pixel));
+      }
+    }
+  }
+}
+
+// Part of the checksum of the tile at x0, y0 in an image imageWidth wide
+uint64_t checksumTile(bmpImageChannel const *tile, int channels, int x0, int y0, int imageWidth) {
+  int values = tile->width;
+  uint64_t sum = 0;
+  #pragma omp parallel for schedule(static) reduction(+:sum)
+  for (int y = 0; y < (int)tile->height; y++) {
+    uint64_t row = ((uint64_t)(y0 + y) * imageWidth + x0) * channels;
+    for (int i = 0; i < values; i++) {
+      sum += mix64((row + i) << 8 | tile->data[y][i]);
+    }
+  }
+  return sum;
+}
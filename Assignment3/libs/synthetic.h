@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include "bitmap.h"
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+// Synthetic input and checksums of the result
+//
+// Every pixel of a synthetic image is a function of its position and the
+// seed only, so each rank generates its own tile and the image is the same
+// for any number of ranks. With one channel the tile holds the average of
+// the colours, like an image of the same pixels loaded from a file.
+//
+// The checksum of an image is a sum over its values, each mixed with its
+// position, so the sums of the tiles add up to the same checksum for any
+// grid, and an image read from a file has the same checksum as the same
+// image generated.
+
+enum {
+  SYNTHETIC_NOISE,
+  SYNTHETIC_GRADIENT,
+  SYNTHETIC_CHECKER,
+  SYNTHETIC_PATTERNS
+};
+
+// Side of the squares of the checker pattern
+#define SYNTHETIC_CHECKER_SIZE 64
+
+extern char const *syntheticPatterns[SYNTHETIC_PATTERNS];
+
+int parseSyntheticImage(char const *spec, int *width, int *height, int *pattern);
+void generateSyntheticTile(
+  bmpImageChannel *tile,
+  int channels,
+  int pattern,
+  uint32_t seed,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight
+);
+uint64_t checksumTile(bmpImageChannel const *tile, int channels, int x0, int y0, int imageWidth);
+
+#endif
@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "tasks.h"
+#include "grid.h"
+#include "trace.h"
+
+static int const directionX[TASK_DIRECTIONS] = {0, 0, 1, -1, 1, -1, 1, -1};
+static int const directionY[TASK_DIRECTIONS] = {-1, 1, 0, 0, -1, -1, 1, 1};
+static int const opposite[TASK_DIRECTIONS] = {
+  TASK_SOUTH, TASK_NORTH, TASK_WEST, TASK_EAST,
+  TASK_SOUTHWEST, TASK_SOUTHEAST, TASK_NORTHWEST, TASK_NORTHEAST
+};
+
+// Cells of a width x height tile towards direction d, either its ghost cells
+// or the cells inside next to them
+static tileRegion facingRegion(int d, int width, int height, int count, int ghost) {
+  tileRegion region;
+  if (directionX[d] < 0) {
+    region.x0 = ghost ? -count : 0;
+    region.x1 = ghost ? 0 : count;
+  } else if (directionX[d] > 0) {
+    region.x0 = ghost ? width : width - count;
+    region.x1 = ghost ? width + count : width;
+  } else {
+    region.x0 = 0;
+    region.x1 = width;
+  }
+  if (directionY[d] < 0) {
+    region.y0 = ghost ? -count : 0;
+    region.y1 = ghost ? 0 : count;
+  } else if (directionY[d] > 0) {
+    region.y0 = ghost ? height : height - count;
+    region.y1 = ghost ? height + count : height;
+  } else {
+    region.y0 = 0;
+    region.y1 = height;
+  }
+  return region;
+}
+
+static MPI_Datatype newRegionType(imageTile const *tile, tileRegion const *region) {
+  MPI_Datatype type;
+  MPI_Type_vector(
+      region->y1 - region->y0, (region->x1 - region->x0) * tile->channels, tile->stride,
+      MPI_BYTE, &type
+  );
+  MPI_Type_commit(&type);
+  return type;
+}
+
+static unsigned char * regionStart(imageTile *tile, tileRegion const *region) {
+  return &tile->data[region->y0][region->x0 * (int)tile->channels];
+}
+
+taskGrid * newTaskGrid(
+  int width,
+  int height,
+  int count,
+  int channels,
+  int tilesX,
+  int tilesY,
+  int rank,
+  int gridWidth,
+  int gridHeight,
+  MPI_Comm comm
+) {
+  int *rowSplit = calcSplit(tilesY, height);
+  int *colSplit = calcSplit(tilesX, width);
+  if (rowSplit[0] < count || colSplit[0] < count) {
+    free(rowSplit);
+    free(colSplit);
+    return NULL;
+  }
+
+  taskGrid *grid = calloc(1, sizeof(taskGrid));
+  grid->tilesX = tilesX;
+  grid->tilesY = tilesY;
+  grid->rank = rank;
+  grid->comm = comm;
+  grid->tiles = calloc(tilesX * tilesY, sizeof(taskTile));
+
+  // Position of the task tiles of this rank in the grid over the image
+  int const globalX = rank % gridWidth * tilesX;
+  int const globalY = rank / gridWidth * tilesY;
+  for (int ty = 0; ty < tilesY; ty++) {
+    for (int tx = 0; tx < tilesX; tx++) {
+      taskTile *tile = &grid->tiles[ty * tilesX + tx];
+      int tileWidth = colSplit[tx];
+      int tileHeight = rowSplit[ty];
+      tile->x0 = calcOffset(colSplit, tx);
+      tile->y0 = calcOffset(rowSplit, ty);
+      tile->frames[0] = newImageTile(tileWidth, tileHeight, count, channels);
+      tile->frames[1] = newImageTile(tileWidth, tileHeight, count, channels);
+
+      for (int d = 0; d < TASK_DIRECTIONS; d++) {
+        int x = globalX + tx + directionX[d];
+        int y = globalY + ty + directionY[d];
+        if (x < 0 || x >= gridWidth * tilesX || y < 0 || y >= gridHeight * tilesY) {
+          tile->rank[d] = MPI_PROC_NULL;
+          tile->index[d] = -1;
+        } else {
+          tile->rank[d] = (y / tilesY) * gridWidth + x / tilesX;
+          tile->index[d] = (y % tilesY) * tilesX + x % tilesX;
+        }
+        tile->ghost[d] = facingRegion(d, tileWidth, tileHeight, count, 1);
+        tile->edge[d] = facingRegion(d, tileWidth, tileHeight, count, 0);
+        tile->ghostType[d] = newRegionType(tile->frames[0], &tile->ghost[d]);
+        tile->edgeType[d] = newRegionType(tile->frames[0], &tile->edge[d]);
+        if (tile->rank[d] == rank) {
+          grid->copies++;
+        } else if (tile->rank[d] != MPI_PROC_NULL) {
+          grid->receives++;
+        }
+      }
+
+      tileRegion limit = {
+        .x0 = (tile->rank[TASK_WEST] != MPI_PROC_NULL) ? -count : 0,
+        .x1 = tileWidth + ((tile->rank[TASK_EAST] != MPI_PROC_NULL) ? count : 0),
+        .y0 = (tile->rank[TASK_NORTH] != MPI_PROC_NULL) ? -count : 0,
+        .y1 = tileHeight + ((tile->rank[TASK_SOUTH] != MPI_PROC_NULL) ? count : 0),
+      };
+      tile->limit = limit;
+    }
+  }
+
+  // Every remote ghost region received is matched by one sent back
+  grid->sends = grid->receives;
+  grid->requests = malloc((grid->receives + grid->sends) * sizeof(MPI_Request));
+  grid->receiver = malloc(grid->receives * sizeof(int));
+  grid->completed = malloc(grid->receives * sizeof(int));
+  free(rowSplit);
+  free(colSplit);
+  return grid;
+}
+
+void freeTaskGrid(taskGrid *grid) {
+  if (grid == NULL) {
+    return;
+  }
+  for (int t = 0; t < grid->tilesX * grid->tilesY; t++) {
+    taskTile *tile = &grid->tiles[t];
+    for (int d = 0; d < TASK_DIRECTIONS; d++) {
+      MPI_Type_free(&tile->ghostType[d]);
+      MPI_Type_free(&tile->edgeType[d]);
+    }
+    freeImageTile(tile->frames[0]);
+    freeImageTile(tile->frames[1]);
+  }
+  free(grid->tiles);
+  free(grid->requests);
+  free(grid->receiver);
+  free(grid->completed);
+  free(grid);
+}
+
+// The inside of the tile of the rank into the current frames, and back
+void copyTileToTaskGrid(taskGrid *grid, imageTile *tile) {
+  int const channels = tile->channels;
+  for (int t = 0; t < grid->tilesX * grid->tilesY; t++) {
+    imageTile *frame = grid->tiles[t].frames[grid->current];
+    for (unsigned int y = 0; y < frame->height; y++) {
+      memcpy(
+          frame->data[y], &tile->data[grid->tiles[t].y0 + y][grid->tiles[t].x0 * channels],
+          frame->width * channels
+      );
+    }
+  }
+}
+
+void copyTaskGridToTile(imageTile *tile, taskGrid *grid) {
+  int const channels = tile->channels;
+  for (int t = 0; t < grid->tilesX * grid->tilesY; t++) {
+    imageTile *frame = grid->tiles[t].frames[grid->current];
+    for (unsigned int y = 0; y < frame->height; y++) {
+      memcpy(
+          &tile->data[grid->tiles[t].y0 + y][grid->tiles[t].x0 * channels], frame->data[y],
+          frame->width * channels
+      );
+    }
+  }
+}
+
+// Copies the ghost cells from the neighbours on this rank and computes the
+// next state of the task tile. The neighbours only write their other frame
+// during the iteration, so the cells copied stay valid.
+static void runTaskTile(taskGrid *grid, taskTile *tile, kernelPipeline const *pipeline) {
+  int const current = grid->current;
+  imageTile *in = tile->frames[current];
+  int const channels = in->channels;
+  for (int d = 0; d < TASK_DIRECTIONS; d++) {
+    if (tile->rank[d] != grid->rank) {
+      continue;
+    }
+    taskTile const *from = &grid->tiles[tile->index[d]];
+    tileRegion const *ghost = &tile->ghost[d];
+    tileRegion const *edge = &from->edge[opposite[d]];
+    for (int y = 0; y < ghost->y1 - ghost->y0; y++) {
+      memcpy(
+          &in->data[ghost->y0 + y][ghost->x0 * channels],
+          &from->frames[current]->data[edge->y0 + y][edge->x0 * channels],
+          (ghost->x1 - ghost->x0) * channels
+      );
+    }
+  }
+  tileRegion region = {.x0 = 0, .x1 = in->width, .y0 = 0, .y1 = in->height};
+  applyKernelPipeline(tile->frames[1 - current], in, &region, &tile->limit, pipeline);
+}
+
+// A ready task tile is both spawned as a task and may be run by the master
+// thread while it polls, whoever claims it first runs it
+static int claimTaskTile(taskTile *tile) {
+  int claimed;
+  #pragma omp atomic capture
+  claimed = tile->claimed++;
+  return claimed == 0;
+}
+
+static void startTaskTile(taskGrid *grid, int t, kernelPipeline const *pipeline) {
+  #pragma omp task firstprivate(t)
+  if (claimTaskTile(&grid->tiles[t])) {
+    runTaskTile(grid, &grid->tiles[t], pipeline);
+  }
+}
+
+// One iteration of all task tiles of the rank. The time the master thread
+// spends running tiles is traced as compute, polling for messages as wait.
+void applyTaskGrid(taskGrid *grid, kernelPipeline const *pipeline, int iteration) {
+  int const tiles = grid->tilesX * grid->tilesY;
+  int const current = grid->current;
+  double traceStart = traceBegin();
+
+  // A remote ghost region of task tile t from direction d carries the tag
+  // t * TASK_DIRECTIONS + d
+  int receive = 0;
+  int send = grid->receives;
+  for (int t = 0; t < tiles; t++) {
+    taskTile *tile = &grid->tiles[t];
+    tile->missing = 0;
+    tile->claimed = 0;
+    for (int d = 0; d < TASK_DIRECTIONS; d++) {
+      if (tile->rank[d] == grid->rank || tile->rank[d] == MPI_PROC_NULL) {
+        continue;
+      }
+      MPI_Irecv(
+          regionStart(tile->frames[current], &tile->ghost[d]), 1, tile->ghostType[d],
+          tile->rank[d], t * TASK_DIRECTIONS + d, grid->comm, &grid->requests[receive]
+      );
+      grid->receiver[receive++] = t;
+      tile->missing++;
+      MPI_Isend(
+          regionStart(tile->frames[current], &tile->edge[d]), 1, tile->edgeType[d],
+          tile->rank[d], tile->index[d] * TASK_DIRECTIONS + opposite[d], grid->comm,
+          &grid->requests[send++]
+      );
+    }
+  }
+  traceEnd(TRACE_PACK, iteration, traceStart);
+
+  #pragma omp parallel
+  {
+    #pragma omp master
+    {
+      for (int t = 0; t < tiles; t++) {
+        if (grid->tiles[t].missing == 0) {
+          startTaskTile(grid, t, pipeline);
+        }
+      }
+
+      // Start the tiles whose last ghost region came in as soon as the
+      // poll sees it. Between polls that found nothing the master yields,
+      // and as taskyield need not run anything (libgomp's does not), runs
+      // a ready tile no thread took yet itself.
+      int arrived = 0;
+      double start = traceBegin();
+      while (arrived < grid->receives) {
+        int completed = 0;
+        MPI_Testsome(grid->receives, grid->requests, &completed, grid->completed, MPI_STATUSES_IGNORE);
+        for (int r = 0; r < completed; r++) {
+          int t = grid->receiver[grid->completed[r]];
+          if (--grid->tiles[t].missing == 0) {
+            startTaskTile(grid, t, pipeline);
+          }
+        }
+        arrived += completed;
+        if (completed > 0) {
+          continue;
+        }
+
+        #pragma omp taskyield
+        for (int t = 0; t < tiles; t++) {
+          if (grid->tiles[t].missing == 0 && claimTaskTile(&grid->tiles[t])) {
+            traceEnd(TRACE_WAIT, iteration, start);
+            start = traceBegin();
+            runTaskTile(grid, &grid->tiles[t], pipeline);
+            traceEnd(TRACE_COMPUTE, iteration, start);
+            start = traceBegin();
+            break;
+          }
+        }
+      }
+      traceEnd(TRACE_WAIT, iteration, start);
+
+      start = traceBegin();
+      #pragma omp taskwait
+      traceEnd(TRACE_COMPUTE, iteration, start);
+
+      // The cells sent are written again in the next iteration
+      start = traceBegin();
+      MPI_Waitall(grid->sends, &grid->requests[grid->receives], MPI_STATUSES_IGNORE);
+      traceEnd(TRACE_WAIT, iteration, start);
+    }
+  }
+  grid->current = 1 - current;
+}
@@ -0,0 +1,100 @@
+#include <mpi.h>
+#include "pipeline.h"
+#include "tile.h"
+
+#ifndef TASKS_H
+#define TASKS_H
+
+// Over-decomposed tiles run as tasks
+//
+// The tile of a rank is split into a grid of smaller tiles, each with both
+// frames and ghost cells of its own. All ranks split their tiles the same
+// way, so the small tiles form one grid over the image and every tile has
+// up to eight neighbours, on this rank or another one. An iteration posts
+// the receives of all ghost cells coming from other ranks and the sends
+// going to them, then starts a tile as an OpenMP task as soon as all of
+// its remote ghost cells have arrived. Tiles inside the rank start right
+// away, so their computation hides the latency of the messages of the
+// others. A task copies the ghost cells from the neighbours on the rank
+// itself and computes the tile.
+//
+// Each of the eight ghost regions, corners included, comes straight from
+// the neighbour owning it, so unlike exchangeTileHalo there is no order
+// between the exchanges. Every tile is at least as large as the halo.
+//
+// Only the master thread calls MPI. It polls for the ghost cells and starts
+// the tiles they complete, and runs tiles itself in between, so a tile starts
+// as soon as its last message is seen whatever the other threads are doing.
+
+// Order of the neighbours of a task tile
+enum {
+  TASK_NORTH,
+  TASK_SOUTH,
+  TASK_EAST,
+  TASK_WEST,
+  TASK_NORTHEAST,
+  TASK_NORTHWEST,
+  TASK_SOUTHEAST,
+  TASK_SOUTHWEST,
+  TASK_DIRECTIONS
+};
+
+typedef struct {
+  // Offset of the task tile in the tile of the rank, in pixels
+  int x0;
+  int y0;
+  imageTile *frames[2];
+  // Rank owning the neighbour in every direction, MPI_PROC_NULL outside
+  // the image, and its index in the task tiles of that rank
+  int rank[TASK_DIRECTIONS];
+  int index[TASK_DIRECTIONS];
+  // Ghost cells received from every direction and the cells sent there
+  tileRegion ghost[TASK_DIRECTIONS];
+  tileRegion edge[TASK_DIRECTIONS];
+  MPI_Datatype ghostType[TASK_DIRECTIONS];
+  MPI_Datatype edgeType[TASK_DIRECTIONS];
+  // Part of the frame holding image cells, for the pipeline
+  tileRegion limit;
+  // Remote ghost regions of this iteration that have not arrived yet
+  int missing;
+  // Nonzero once a thread took the tile in this iteration
+  int claimed;
+} taskTile;
+
+typedef struct {
+  int tilesX;
+  int tilesY;
+  int rank;
+  MPI_Comm comm;
+  taskTile *tiles;
+  // Index of the frame holding the current state of every task tile
+  int current;
+  // Receives of one iteration first, then the sends
+  int receives;
+  int sends;
+  MPI_Request *requests;
+  // Task tile of every receive
+  int *receiver;
+  int *completed;
+  // Ghost regions copied between task tiles of this rank per iteration
+  int copies;
+} taskGrid;
+
+taskGrid * newTaskGrid(
+  int width,
+  int height,
+  int count,
+  int channels,
+  int tilesX,
+  int tilesY,
+  int rank,
+  int gridWidth,
+  int gridHeight,
+  MPI_Comm comm
+);
+void freeTaskGrid(taskGrid *grid);
+void copyTileToTaskGrid(taskGrid *grid, imageTile *tile);
+void copyTaskGridToTile(imageTile *tile, taskGrid *grid);
+void applyTaskGrid(taskGrid *grid, kernelPipeline const *pipeline, int iteration);
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "temporal.h"
+
+temporalBlocking * newTemporalBlocking(
+  imageTile *tile,
+  int depth,
+  int radius,
+  int cacheBytes
+) {
+  temporalBlocking *blocking = malloc(sizeof(temporalBlocking));
+  if (blocking == NULL) {
+    return NULL;
+  }
+  blocking->depth = depth;
+  blocking->bytes = 0;
+  blocking->untiledBytes = 0;
+  blocking->pixelIterations = 0;
+
+  // Largest square block where both scratch frames fit in the cache, but
+  // never smaller than the halo around it
+  int halo = radius * depth;
+  int side = (halo > 8) ? halo : 8;
+  int pixelBytes = 2 * tile->channels;
+  while (pixelBytes * (side + 1 + 2 * halo) * (side + 1 + 2 * halo) <= cacheBytes) {
+    side++;
+  }
+  blocking->blockWidth = (side < (int)tile->width) ? side : (int)tile->width;
+  blocking->blockHeight = (side < (int)tile->height) ? side : (int)tile->height;
+  return blocking;
+}
+
+void freeTemporalBlocking(temporalBlocking *blocking) {
+  free(blocking);
+}
+
+// Copy a block of a frame together with count cells around it
+static void copyFrameBlock(
+  imageTile *to,
+  imageTile *from,
+  int x0,
+  int y0,
+  int width,
+  int height,
+  int count
+) {
+  int channels = from->channels;
+  for (int y = -count; y < height + count; y++) {
+    memcpy(&to->data[y][-count * channels], &from->data[y0 + y][(x0 - count) * channels],
+        (width + 2 * count) * channels);
+  }
+}
+
+// Advance every block of in by steps iterations and write the blocks to out.
+// The halo of in has to be exchanged and at least radius * steps deep.
+void applyTemporalBlocks(
+  imageTile *out,
+  imageTile *in,
+  tileExchange const *exchange,
+  int steps,
+  kernelPipeline const *pipeline,
+  temporalBlocking *blocking
+) {
+  int const radius = pipeline->radius;
+  int const halo = radius * steps;
+  int const width = in->width;
+  int const height = in->height;
+  int const channels = in->channels;
+  int const blockWidth = blocking->blockWidth;
+  int const blockHeight = blocking->blockHeight;
+  int const blocksX = (width + blockWidth - 1) / blockWidth;
+  int const blocksY = (height + blockHeight - 1) / blockHeight;
+
+  // Cells the tile computes in the last step and how far that grows per
+  // earlier step. Cells outside the image are never computed.
+  int const growWest = (exchange->west != MPI_PROC_NULL);
+  int const growEast = (exchange->east != MPI_PROC_NULL);
+  int const growNorth = (exchange->north != MPI_PROC_NULL);
+  int const growSouth = (exchange->south != MPI_PROC_NULL);
+  double bytes = 0;
+
+  #pragma omp parallel reduction(+:bytes)
+  {
+    imageTile *scratch = newImageTile(blockWidth, blockHeight, halo, channels);
+    imageTile *processScratch = newImageTile(blockWidth, blockHeight, halo, channels);
+
+    #pragma omp for schedule(dynamic)
+    for (int block = 0; block < blocksX * blocksY; block++) {
+      int bx0 = (block % blocksX) * blockWidth;
+      int by0 = (block / blocksX) * blockHeight;
+      int bw = (bx0 + blockWidth < width) ? blockWidth : width - bx0;
+      int bh = (by0 + blockHeight < height) ? blockHeight : height - by0;
+
+      // Both frames start as a copy of the block, so cells outside the
+      // image are zero in both of them
+      imageTile *a = scratch;
+      imageTile *b = processScratch;
+
+      // Intermediate pipeline stages may use every cell but those outside
+      // the image
+      tileRegion limit = {
+        .x0 = growWest ? -halo : -bx0,
+        .x1 = growEast ? bw + halo : width - bx0,
+        .y0 = growNorth ? -halo : -by0,
+        .y1 = growSouth ? bh + halo : height - by0,
+      };
+      copyFrameBlock(a, in, bx0, by0, bw, bh, halo);
+      copyFrameBlock(b, in, bx0, by0, bw, bh, halo);
+      bytes += ((double)(bw + 2 * halo) * (bh + 2 * halo) + (double)bw * bh) * channels;
+
+      for (int step = 0; step < steps; step++) {
+        // The block grows by the cells that later steps still depend on
+        int extend = radius * (steps - 1 - step);
+        int x0 = bx0 - extend;
+        int x1 = bx0 + bw + extend;
+        int y0 = by0 - extend;
+        int y1 = by0 + bh + extend;
+        int minX = growWest ? -extend : 0;
+        int maxX = width + (growEast ? extend : 0);
+        int minY = growNorth ? -extend : 0;
+        int maxY = height + (growSouth ? extend : 0);
+
+        tileRegion region = {
+          .x0 = ((x0 > minX) ? x0 : minX) - bx0,
+          .x1 = ((x1 < maxX) ? x1 : maxX) - bx0,
+          .y0 = ((y0 > minY) ? y0 : minY) - by0,
+          .y1 = ((y1 < maxY) ? y1 : maxY) - by0,
+        };
+        applyKernelPipeline(b, a, &region, &limit, pipeline);
+        swapImageTile(&a, &b);
+      }
+
+      for (int y = 0; y < bh; y++) {
+        memcpy(&out->data[by0 + y][bx0 * channels], a->data[y], bw * channels);
+      }
+    }
+
+    freeImageTile(scratch);
+    freeImageTile(processScratch);
+  }
+
+  // Without blocking, every step reads its region and the cells around it
+  // and writes the region
+  for (int step = 0; step < steps; step++) {
+    int extend = radius * (steps - 1 - step);
+    double regionWidth = width + extend * (growWest + growEast);
+    double regionHeight = height + extend * (growNorth + growSouth);
+    blocking->untiledBytes += (regionWidth + 2 * radius) * (regionHeight + 2 * radius) * channels;
+    blocking->untiledBytes += regionWidth * regionHeight * channels;
+  }
+  blocking->bytes += bytes;
+  blocking->pixelIterations += (double)width * height * steps;
+}
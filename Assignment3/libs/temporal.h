@@ -0,0 +1,46 @@
+#include "pipeline.h"
+#include "tile.h"
+
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+
+// Temporal blocking
+//
+// Instead of streaming the whole tile through memory for every iteration,
+// the tile is cut into blocks small enough that two copies of a block and
+// its halo fit in the cache. Every block is advanced all iterations between
+// two halo exchanges at once: the block is copied into a scratch frame with
+// a halo of radius * depth, which shrinks by the kernel radius after every
+// iteration (overlapped trapezoids), and only the block itself is written
+// back. The cells near the block border are computed by more than one block,
+// in exchange the tile is read and written once per exchange. The radius is
+// that of the whole pipeline.
+
+typedef struct {
+  int depth;
+  int blockWidth;
+  int blockHeight;
+  // Estimated bytes moved between memory and cache, the same estimate for
+  // iterating over the whole tile, and the number of pixel-iterations
+  double bytes;
+  double untiledBytes;
+  double pixelIterations;
+} temporalBlocking;
+
+temporalBlocking * newTemporalBlocking(
+  imageTile *tile,
+  int depth,
+  int radius,
+  int cacheBytes
+);
+void freeTemporalBlocking(temporalBlocking *blocking);
+void applyTemporalBlocks(
+  imageTile *out,
+  imageTile *in,
+  tileExchange const *exchange,
+  int steps,
+  kernelPipeline const *pipeline,
+  temporalBlocking *blocking
+);
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tile.h"
+
+void freeImageTile(imageTile *tile) {
+  if (tile == NULL) {
+    return;
+  }
+  if (tile->rawdata != NULL) {
+    free(tile->rawdata);
+  }
+  if (tile->rows != NULL) {
+    free(tile->rows);
+  }
+  free(tile);
+}
+
+// Bytes of the frame of a tile, ghost cells included
+size_t imageTileBytes(int width, int height, int count, int channels) {
+  return (size_t)(height + 2 * count) * (width + 2 * count) * channels;
+}
+
+// Tile on a frame of imageTileBytes() bytes owned by the caller
+imageTile * newImageTileView(unsigned char *rawdata, int width, int height, int count, int channels) {
+  imageTile *tile = malloc(sizeof(imageTile));
+  if (tile == NULL) {
+    return NULL;
+  }
+
+  tile->width = width;
+  tile->height = height;
+  tile->count = count;
+  tile->channels = channels;
+  tile->stride = (width + 2 * count) * channels;
+  tile->rawdata = rawdata;
+
+  int totalHeight = height + 2 * count;
+  tile->rows = malloc(totalHeight * sizeof(unsigned char *));
+  if (tile->rows == NULL) {
+    free(tile);
+    return NULL;
+  }
+
+  // Row pointers point at the first column inside the tile, and data points
+  // at the first row inside the tile, so negative indices reach the ghosts
+  for (int i = 0; i < totalHeight; i++) {
+    tile->rows[i] = &(tile->rawdata[i * tile->stride + count * channels]);
+  }
+  tile->data = &(tile->rows[count]);
+  return tile;
+}
+
+void freeImageTileView(imageTile *tile) {
+  if (tile == NULL) {
+    return;
+  }
+  free(tile->rows);
+  free(tile);
+}
+
+imageTile * newImageTile(int width, int height, int count, int channels) {
+  // Ghost cells outside the image are never written and stay zero
+  unsigned char *rawdata = calloc(imageTileBytes(width, height, count, channels), sizeof(unsigned char));
+  if (rawdata == NULL) {
+    return NULL;
+  }
+  imageTile *tile = newImageTileView(rawdata, width, height, count, channels);
+  if (tile == NULL) {
+    free(rawdata);
+  }
+  return tile;
+}
+
+void swapImageTile(imageTile **one, imageTile **two) {
+  imageTile *tmp = *two;
+  *two = *one;
+  *one = tmp;
+}
+
+// The channel holds the interleaved channels of width pixels in every row
+void copyChannelToTile(imageTile *tile, bmpImageChannel *channel) {
+  for (unsigned int y = 0; y < tile->height; y++) {
+    memcpy(tile->data[y], channel->data[y], tile->width * tile->channels);
+  }
+}
+
+void copyTileToChannel(bmpImageChannel *channel, imageTile *tile) {
+  for (unsigned int y = 0; y < tile->height; y++) {
+    memcpy(channel->data[y], tile->data[y], tile->width * tile->channels);
+  }
+}
+
+// Number of bytes inside the tiles that differ
+long countTileChanges(imageTile *one, imageTile *two) {
+  int const bytes = one->width * one->channels;
+  long changes = 0;
+  #pragma omp parallel for schedule(static) reduction(+:changes)
+  for (int y = 0; y < (int)one->height; y++) {
+    unsigned char const *a = one->data[y];
+    unsigned char const *b = two->data[y];
+    for (int x = 0; x < bytes; x++) {
+      changes += (a[x] != b[x]);
+    }
+  }
+  return changes;
+}
+
+// 1 if the ghost cells of both tiles are the same
+int equalTileGhosts(imageTile *one, imageTile *two) {
+  int const count = one->count;
+  int const height = one->height;
+  int const stride = one->stride;
+  int const side = count * one->channels;
+  int const width = one->width * one->channels;
+
+  // Whole ghost rows above and below the tile
+  if (memcmp(one->rawdata, two->rawdata, count * stride) != 0) {
+    return 0;
+  }
+  if (memcmp(one->data[height] - side, two->data[height] - side, count * stride) != 0) {
+    return 0;
+  }
+  for (int y = 0; y < height; y++) {
+    if (
+      memcmp(one->data[y] - side, two->data[y] - side, side) != 0 ||
+      memcmp(one->data[y] + width, two->data[y] + width, side) != 0
+    ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+tileExchange * newTileExchange(
+  imageTile *tile,
+  int north,
+  int south,
+  int east,
+  int west,
+  MPI_Comm comm
+) {
+  tileExchange *exchange = malloc(sizeof(tileExchange));
+  if (exchange == NULL) {
+    return NULL;
+  }
+  exchange->north = north;
+  exchange->south = south;
+  exchange->east = east;
+  exchange->west = west;
+  exchange->comm = comm;
+
+  // The east and west halos are count columns of every row inside the tile,
+  // with all channels of a pixel next to each other
+  MPI_Type_vector(tile->height, tile->count * tile->channels, tile->stride, MPI_BYTE, &exchange->column);
+  MPI_Type_commit(&exchange->column);
+  return exchange;
+}
+
+void freeTileExchange(tileExchange *exchange) {
+  if (exchange == NULL) {
+    return;
+  }
+  MPI_Type_free(&exchange->column);
+  free(exchange);
+}
+
+void exchangeTileHalo(imageTile *tile, tileExchange *exchange) {
+  exchangeTileColumns(tile, exchange);
+  exchangeTileRows(tile, exchange);
+}
+
+void exchangeTileColumns(imageTile *tile, tileExchange *exchange) {
+  int count = tile->count;
+  int width = tile->width;
+  int channels = tile->channels;
+
+  // Send east and receive from west, then the other way around
+  MPI_Sendrecv(
+    &tile->data[0][(width - count) * channels], 1, exchange->column, exchange->east, 0,
+    &tile->data[0][-count * channels], 1, exchange->column, exchange->west, 0,
+    exchange->comm, MPI_STATUS_IGNORE
+  );
+  MPI_Sendrecv(
+    &tile->data[0][0], 1, exchange->column, exchange->west, 1,
+    &tile->data[0][width * channels], 1, exchange->column, exchange->east, 1,
+    exchange->comm, MPI_STATUS_IGNORE
+  );
+}
+
+// North and south halos are whole rows of the frame. They include the east
+// and west ghosts received by exchangeTileColumns, which fills in the corners.
+void exchangeTileRows(imageTile *tile, tileExchange *exchange) {
+  int count = tile->count;
+  int height = tile->height;
+  int channels = tile->channels;
+  int rowBytes = count * tile->stride;
+  MPI_Sendrecv(
+    &tile->data[height - count][-count * channels], rowBytes, MPI_BYTE, exchange->south, 2,
+    &tile->data[-count][-count * channels], rowBytes, MPI_BYTE, exchange->north, 2,
+    exchange->comm, MPI_STATUS_IGNORE
+  );
+  MPI_Sendrecv(
+    &tile->data[0][-count * channels], rowBytes, MPI_BYTE, exchange->north, 3,
+    &tile->data[height][-count * channels], rowBytes, MPI_BYTE, exchange->south, 3,
+    exchange->comm, MPI_STATUS_IGNORE
+  );
+}
@@ -0,0 +1,74 @@
+#include <stddef.h>
+#include <mpi.h>
+#include "bitmap.h"
+
+#ifndef TILE_H
+#define TILE_H
+
+// A tile stores the part of the image channel owned by one process together
+// with its halo as ghost rows and columns in one contiguous frame.
+//
+// data[y][x] is valid for -count <= y < height + count and
+// -count <= x < width + count, so a kernel can read across the border of the
+// tile without checking which halo the value belongs to. Received halos are
+// written directly into the frame.
+//
+// A tile of several channels stores them interleaved, so pixel x of channel c
+// is data[y][x * channels + c]. Width, count and regions are in pixels, the
+// stride is in bytes.
+
+typedef struct {
+  unsigned int width;
+  unsigned int height;
+  unsigned int count;
+  unsigned int channels;
+  unsigned int stride;
+  unsigned char *rawdata;
+  unsigned char **rows;
+  unsigned char **data;
+} imageTile;
+
+// Part of a tile to compute, in the coordinates of data[y][x]
+typedef struct {
+  int x0;
+  int x1;
+  int y0;
+  int y1;
+} tileRegion;
+
+// Neighbours of a tile and the datatype describing its east/west halo.
+// Neighbours that do not exist are MPI_PROC_NULL.
+typedef struct {
+  int north;
+  int south;
+  int east;
+  int west;
+  MPI_Comm comm;
+  MPI_Datatype column;
+} tileExchange;
+
+imageTile * newImageTile(int width, int height, int count, int channels);
+size_t imageTileBytes(int width, int height, int count, int channels);
+imageTile * newImageTileView(unsigned char *rawdata, int width, int height, int count, int channels);
+void freeImageTileView(imageTile *tile);
+void freeImageTile(imageTile *tile);
+void swapImageTile(imageTile **one, imageTile **two);
+void copyChannelToTile(imageTile *tile, bmpImageChannel *channel);
+void copyTileToChannel(bmpImageChannel *channel, imageTile *tile);
+long countTileChanges(imageTile *one, imageTile *two);
+int equalTileGhosts(imageTile *one, imageTile *two);
+
+tileExchange * newTileExchange(
+  imageTile *tile,
+  int north,
+  int south,
+  int east,
+  int west,
+  MPI_Comm comm
+);
+void freeTileExchange(tileExchange *exchange);
+void exchangeTileHalo(imageTile *tile, tileExchange *exchange);
+void exchangeTileColumns(imageTile *tile, tileExchange *exchange);
+void exchangeTileRows(imageTile *tile, tileExchange *exchange);
+
+#endif
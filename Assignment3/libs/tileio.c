@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tileio.h"
+
+// File view of the tile at x0, y0 with the given size in pixels. The tile at
+// the east border of the image also covers the padding of its rows.
+static MPI_Datatype tileFileType(
+  int x0,
+  int y0,
+  int width,
+  int height,
+  int imageWidth,
+  int imageHeight,
+  int padding
+) {
+  int sizes[2] = {imageHeight, bmpLineSize(imageWidth)};
+  int subsizes[2] = {height, width * sizeof(pixel) + padding};
+  int starts[2] = {y0, x0 * sizeof(pixel)};
+  MPI_Datatype type;
+  MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_BYTE, &type);
+  MPI_Type_commit(&type);
+  return type;
+}
+
+int readBmpTile(
+  bmpImageChannel *tile,
+  int channels,
+  char const *filename,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight,
+  MPI_Comm comm
+) {
+  int width = tile->width / channels;
+  int height = tile->height;
+  int count = width * height;
+  MPI_File file;
+  if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    return 1;
+  }
+
+  // Three channels are read straight into the tile, one channel through a
+  // buffer of pixels
+  pixel *buffer = (channels == 1) ? malloc(count * sizeof(pixel)) : (pixel *)tile->rawdata;
+  MPI_Datatype type = tileFileType(x0, y0, width, height, imageWidth, imageHeight, 0);
+  MPI_File_set_view(file, BMP_HEADER_SIZE, MPI_BYTE, type, "native", MPI_INFO_NULL);
+  MPI_Status status;
+  int ret = MPI_File_read_all(file, buffer, count * sizeof(pixel), MPI_BYTE, &status) != MPI_SUCCESS;
+  int bytesRead = 0;
+  MPI_Get_count(&status, MPI_BYTE, &bytesRead);
+  ret |= (bytesRead != count * (int)sizeof(pixel));
+
+  if (channels == 1) {
+    for (int i = 0; i < count; i++) {
+      tile->rawdata[i] = extractAverage(buffer[i]);
+    }
+    free(buffer);
+  }
+  MPI_Type_free(&type);
+  MPI_File_close(&file);
+  MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, comm);
+  return ret;
+}
+
+int writeBmpTile(
+  bmpImageChannel *tile,
+  int channels,
+  char const *filename,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight,
+  MPI_Comm comm
+) {
+  int width = tile->width / channels;
+  int height = tile->height;
+  int padding = 0;
+  if (x0 + width == imageWidth) {
+    padding = bmpLineSize(imageWidth) - imageWidth * sizeof(pixel);
+  }
+  int rowBytes = width * sizeof(pixel) + padding;
+
+  MPI_File file;
+  if (MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    return 1;
+  }
+  // Every byte after the header is written by one of the tiles, the size
+  // only cuts off what an older, larger file had beyond the image
+  MPI_File_set_size(file, BMP_HEADER_SIZE + (MPI_Offset)bmpLineSize(imageWidth) * imageHeight);
+
+  int ret = 0;
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  if (rank == 0) {
+    unsigned char header[BMP_HEADER_SIZE];
+    createBmpHeader(header, imageWidth, imageHeight);
+    ret = MPI_File_write_at(file, 0, header, BMP_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+  }
+
+  // Rows of pixels in file layout, the padding stays zero
+  unsigned char *buffer = calloc(rowBytes * height, sizeof(unsigned char));
+  for (int y = 0; y < height; y++) {
+    pixel *row = (pixel *)&buffer[y * rowBytes];
+    if (channels == 1) {
+      for (int x = 0; x < width; x++) {
+        row[x] = mapEqual(tile->data[y][x]);
+      }
+    } else {
+      memcpy(row, tile->data[y], width * sizeof(pixel));
+    }
+  }
+
+  MPI_Datatype type = tileFileType(x0, y0, width, height, imageWidth, imageHeight, padding);
+  MPI_File_set_view(file, BMP_HEADER_SIZE, MPI_BYTE, type, "native", MPI_INFO_NULL);
+  ret |= MPI_File_write_all(file, buffer, rowBytes * height, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+
+  free(buffer);
+  MPI_Type_free(&type);
+  MPI_File_close(&file);
+  MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, comm);
+  return ret;
+}
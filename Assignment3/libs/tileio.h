@@ -0,0 +1,40 @@
+#include <mpi.h>
+#include "bitmap.h"
+
+#ifndef TILEIO_H
+#define TILEIO_H
+
+// Collective MPI-IO of tiles in a BMP file
+//
+// Every rank sets a file view with a subarray type selecting its own tile
+// from the rows of the file, including the padding at the end of every row,
+// and all ranks read or write at once. Rows are in file order, the same
+// order loadBmpImage and saveBmpImage use for data[y], so no rank ever holds
+// more than its own tile and nothing has to be reassembled.
+//
+// With one channel the tile holds the average of the colours, which is
+// written back as grey, like extractAverage and mapEqual. With three
+// channels it holds the blue, green and red values interleaved.
+
+int readBmpTile(
+  bmpImageChannel *tile,
+  int channels,
+  char const *filename,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight,
+  MPI_Comm comm
+);
+int writeBmpTile(
+  bmpImageChannel *tile,
+  int channels,
+  char const *filename,
+  int x0,
+  int y0,
+  int imageWidth,
+  int imageHeight,
+  MPI_Comm comm
+);
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <time.h>
+#include "trace.h"
+
+typedef struct {
+  double start;
+  double end;
+  int phase;
+  int iteration;
+} traceEvent;
+
+static char const *phaseNames[TRACE_PHASES] = {
+  "load", "scatter", "pack", "wait", "compute", "balance", "gather", "save", "checkpoint"
+};
+
+bool traceEnabled = false;
+
+static int traceRank = 0;
+static double traceOrigin = 0;
+static double phaseTotals[TRACE_PHASES];
+static bool traceKeepEvents = false;
+static traceEvent *events = NULL;
+static int eventCount = 0;
+static int eventCapacity = 0;
+
+// Seconds on a clock that never jumps
+double traceClock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void startTrace(int rank, bool keepEvents) {
+  traceEnabled = true;
+  traceRank = rank;
+  traceKeepEvents = keepEvents;
+  traceOrigin = traceClock();
+  for (int phase = 0; phase < TRACE_PHASES; phase++) {
+    phaseTotals[phase] = 0;
+  }
+}
+
+void recordTrace(int phase, int iteration, double start) {
+  double end = traceClock();
+  phaseTotals[phase] += end - start;
+  if (!traceKeepEvents) {
+    return;
+  }
+
+  if (eventCount == eventCapacity) {
+    int capacity = (eventCapacity > 0) ? 2 * eventCapacity : 1024;
+    traceEvent *grown = realloc(events, capacity * sizeof(traceEvent));
+    if (grown == NULL) {
+      // Keep the totals, but stop recording events
+      traceKeepEvents = false;
+      return;
+    }
+    events = grown;
+    eventCapacity = capacity;
+  }
+  events[eventCount].start = start;
+  events[eventCount].end = end;
+  events[eventCount].phase = phase;
+  events[eventCount].iteration = iteration;
+  eventCount++;
+}
+
+// Print the minimum, mean and maximum time of every phase over the ranks.
+// Collective, the report is printed by rank 0.
+void reportTrace(FILE *out, MPI_Comm comm) {
+  int ranks;
+  MPI_Comm_size(comm, &ranks);
+  double min[TRACE_PHASES];
+  double max[TRACE_PHASES];
+  double sum[TRACE_PHASES];
+  MPI_Reduce(phaseTotals, min, TRACE_PHASES, MPI_DOUBLE, MPI_MIN, 0, comm);
+  MPI_Reduce(phaseTotals, max, TRACE_PHASES, MPI_DOUBLE, MPI_MAX, 0, comm);
+  MPI_Reduce(phaseTotals, sum, TRACE_PHASES, MPI_DOUBLE, MPI_SUM, 0, comm);
+  if (traceRank != 0) {
+    return;
+  }
+
+  fprintf(out, "Phases:      seconds over %d ranks\n", ranks);
+  fprintf(out, "             %10s %10s %10s\n", "min", "mean", "max");
+  for (int phase = 0; phase < TRACE_PHASES; phase++) {
+    if (max[phase] > 0) {
+      fprintf(out, "  %-10s %10.6f %10.6f %10.6f\n",
+          phaseNames[phase], min[phase], sum[phase] / ranks, max[phase]);
+    }
+  }
+}
+
+// Write the events of this rank as <prefix>.<rank>.json in the Chrome trace
+// event format. Returns 1 if the file could not be written.
+int writeTrace(char const *prefix) {
+  char filename[1024];
+  snprintf(filename, sizeof(filename), "%s.%d.json", prefix, traceRank);
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    return 1;
+  }
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+      traceRank, traceRank);
+  for (int i = 0; i < eventCount; i++) {
+    traceEvent const *event = &events[i];
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,"
+        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"iteration\":%d}}",
+        phaseNames[event->phase], traceRank,
+        (event->start - traceOrigin) * 1e6, (event->end - event->start) * 1e6,
+        event->iteration);
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  int ret = (fclose(file) != 0);
+  return ret;
+}
+
+void stopTrace(void) {
+  traceEnabled = false;
+  free(events);
+  events = NULL;
+  eventCount = 0;
+  eventCapacity = 0;
+}
@@ -0,0 +1,50 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <mpi.h>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// Phase instrumentation
+//
+// A phase is timed by taking traceBegin() before and calling traceEnd()
+// after it. Both only test a flag while tracing is disabled, so they can stay
+// in the iteration loops. When enabled, the time of every phase is summed
+// per rank with a monotonic clock and, if events are kept, every phase is
+// recorded with its iteration for a Chrome trace (chrome://tracing or
+// ui.perfetto.dev).
+
+enum {
+  TRACE_LOAD,
+  TRACE_SCATTER,
+  TRACE_PACK,
+  TRACE_WAIT,
+  TRACE_COMPUTE,
+  TRACE_BALANCE,
+  TRACE_GATHER,
+  TRACE_SAVE,
+  TRACE_CHECKPOINT,
+  TRACE_PHASES
+};
+
+extern bool traceEnabled;
+
+double traceClock(void);
+void recordTrace(int phase, int iteration, double start);
+
+static inline double traceBegin(void) {
+  return traceEnabled ? traceClock() : 0;
+}
+
+static inline void traceEnd(int phase, int iteration, double start) {
+  if (traceEnabled) {
+    recordTrace(phase, iteration, start);
+  }
+}
+
+void startTrace(int rank, bool keepEvents);
+void reportTrace(FILE *out, MPI_Comm comm);
+int writeTrace(char const *prefix);
+void stopTrace(void);
+
+#endif
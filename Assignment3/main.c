@@ -4,10 +4,24 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <mpi.h>
+#include <omp.h>
 #include "libs/bitmap.h"
 #include "libs/kernel.h"
+#include "libs/pipeline.h"
 #include "libs/halo.h"
 #include "libs/grid.h"
+#include "libs/tile.h"
+#include "libs/fixed.h"
+#include "libs/temporal.h"
+#include "libs/balance.h"
+#include "libs/tileio.h"
+#include "libs/trace.h"
+#include "libs/codec.h"
+#include "libs/shared.h"
+#include "libs/checkpoint.h"
+#include "libs/synthetic.h"
+#include "libs/fusion.h"
+#include "libs/tasks.h"
 
 // Setting to enable/disable border exchange
 const int BORDER_EXCHANGE = 1;
@@ -15,10 +29,18 @@ const int BORDER_EXCHANGE = 1;
 // Exchaning borders every HALO_COUNT iterations
 const int HALO_COUNT = 1;
 
-// Which kernel to use
-int *kernel = (int *)laplacian1Kernel;
-const int kernelSize = 3;
-const float kernelFactor = laplacian1KernelFactor;
+// Cache available to one thread for temporal blocking, in KiB
+const int TEMPORAL_CACHE = 256;
+
+// Imbalance of the compute times, as a fraction of the mean, that has to
+// be exceeded before the split is moved
+const double BALANCE_THRESHOLD = 0.05;
+
+// Which kernel to use unless another one is given with --kernel
+#define DEFAULT_KERNEL "laplacian1"
+
+// Seed of the noise of --synthetic unless another one is given with --seed
+const unsigned int DEFAULT_SEED = 1;
 
 void help(char const *exec, char const opt, char const *optarg) {
   /* Method used to print help text */
@@ -35,14 +57,108 @@ void help(char const *exec, char const opt, char const *optarg) {
   fprintf(out, "\n");
   fprintf(out, "Options:\n");
   fprintf(out, "  -i, --iterations <iterations>    number of iterations (1)\n");
+  fprintf(out, "  -t, --threads <threads>          OpenMP threads per rank (1)\n");
+  fprintf(out, "  -g, --ghost                      store the halo as ghost cells of the tile\n");
+  fprintf(out, "  -c, --colour                     convolve the red, green and blue channels\n");
+  fprintf(out, "                                   instead of their average (implies -g)\n");
+  fprintf(out, "  -k, --kernel <kernel>[,<kernel>] convolution kernel, or kernels applied one\n");
+  fprintf(out, "                                   after the other in one sweep (%s)\n", DEFAULT_KERNEL);
+  fprintf(out, "                                   ");
+  for (kernelEntry const *entry = kernelRegistry; entry->name != NULL; entry++) {
+    fprintf(out, " %s", entry->name);
+  }
+  fprintf(out, "\n");
+  fprintf(out, "                                    box:<radius> gaussbox:<sigma>\n");
+  fprintf(out, "                                    median:<radius> min:<radius> max:<radius>\n");
+  fprintf(out, "                                    percentile:<percent>:<radius>\n");
+  fprintf(out, "                                    erode:<rx>[x<ry>] dilate:.. open:.. close:..\n");
+  fprintf(out, "  -T, --temporal <depth>           advance cache-sized blocks <depth> iterations\n");
+  fprintf(out, "                                   between halo exchanges (implies -g)\n");
+  fprintf(out, "  -C, --cache <KiB>                cache per thread for -T (%d)\n", TEMPORAL_CACHE);
+  fprintf(out, "  -f, --fuse <iterations>          run the iterations of a linear kernel as rounds\n");
+  fprintf(out, "                                   of one composed kernel of <iterations> each, not\n");
+  fprintf(out, "                                   bit-exact, every tile must be <iterations> times\n");
+  fprintf(out, "                                   the kernel radius wide and high\n");
+  fprintf(out, "                                   (implies -g, not with -T, -s, -K or -R)\n");
+  fprintf(out, "  -o, --tasks <tiles>              split the tile of every rank into <tiles> tiles\n");
+  fprintf(out, "                                   run as OpenMP tasks once their halo arrived\n");
+  fprintf(out, "                                   (implies -g, not with -T, -f, -b, -s, -z or -S)\n");
+  fprintf(out, "  -b, --balance <iterations>       move the tile borders by the compute time\n");
+  fprintf(out, "                                   measured every <iterations> (implies -g)\n");
+  fprintf(out, "  -s, --converge <iterations>      skip tiles that stopped changing and stop when\n");
+  fprintf(out, "                                   no pixel changed, checked every <iterations>\n");
+  fprintf(out, "                                   (implies -g, not with -T)\n");
+  fprintf(out, "  -z, --compress                   run-length code halo strips where it pays off\n");
+  fprintf(out, "                                   (implies -g)\n");
+  fprintf(out, "  -S, --shared                     read the halo of neighbours on the same node\n");
+  fprintf(out, "                                   from shared memory (implies -g)\n");
+  fprintf(out, "  -K, --checkpoint <iterations>    write the state of all ranks to one file every\n");
+  fprintf(out, "                                   <iterations> (implies -g)\n");
+  fprintf(out, "  -F, --checkpoint-file <file>     file of --checkpoint (<output-bmp>.ckpt)\n");
+  fprintf(out, "  -R, --restart <file>             continue from a checkpoint up to --iterations\n");
+  fprintf(out, "                                   (implies -g)\n");
+  fprintf(out, "  -m, --mpiio                      read and write the tiles of every rank with\n");
+  fprintf(out, "                                   collective MPI-IO instead of through rank 0\n");
+  fprintf(out, "  -y, --synthetic <spec>           generate the tile of every rank instead of\n");
+  fprintf(out, "                                   reading <input-bmp>, <spec> is <width>x<height>\n");
+  fprintf(out, "                                   [:noise|gradient|checker] (implies -m)\n");
+  fprintf(out, "  -e, --seed <seed>                seed of the --synthetic noise (%d)\n", DEFAULT_SEED);
+  fprintf(out, "  -x, --checksum                   print a checksum of the result instead of\n");
+  fprintf(out, "                                   writing <output-bmp>, the same for any grid\n");
+  fprintf(out, "                                   with -g (implies -m)\n");
+  fprintf(out, "  -p, --profile                    print the time of every phase over the ranks\n");
+  fprintf(out, "  -P, --trace <prefix>             also write a Chrome trace <prefix>.<rank>.json\n");
+  fprintf(out, "  -v, --verify                     check the fixed-point kernels against the\n");
+  fprintf(out, "                                   scalar kernels and exit\n");
 
   fprintf(out, "\n");
   fprintf(out, "Example: %s in.bmp out.bmp -i 10000\n", exec);
+  fprintf(out, "Bench:   %s --synthetic 8192x8192 --checksum -g -i 100\n", exec);
+  fprintf(out, "Hybrid:  mpirun -np <sockets> --bind-to socket %s in.bmp out.bmp -t <cores per socket>\n", exec);
+}
+
+tileExchange * newGridExchange(imageTile *tile, int rank, int gridWidth, int gridHeight) {
+  /* Halo exchange of a tile with its neighbours in the grid */
+  int rankRowNumber = rank / gridWidth;
+  int rankColNumber = rank % gridWidth;
+  return newTileExchange(
+      tile,
+      rankRowNumber > 0 ? rank - gridWidth : MPI_PROC_NULL,
+      rankRowNumber < gridHeight - 1 ? rank + gridWidth : MPI_PROC_NULL,
+      rankColNumber < gridWidth - 1 ? rank + 1 : MPI_PROC_NULL,
+      rankColNumber > 0 ? rank - 1 : MPI_PROC_NULL,
+      MPI_COMM_WORLD
+  );
 }
 
 int main(int argc, char **argv) {
   // Parameter parsing
   unsigned int iterations = 1;
+  int threads = 1;
+  bool ghost = false;
+  int channels = 1;
+  char const *kernelNames = DEFAULT_KERNEL;
+  int temporal = 0;
+  bool fuse = false;
+  int fuseLength = 0;
+  int tasks = 0;
+  int cache = TEMPORAL_CACHE;
+  int balance = 0;
+  int converge = 0;
+  bool compress = false;
+  bool sharedMemory = false;
+  bool mpiio = false;
+  char const *synthetic = NULL;
+  int syntheticWidth = 0;
+  int syntheticHeight = 0;
+  int syntheticPattern = SYNTHETIC_NOISE;
+  unsigned int seed = DEFAULT_SEED;
+  bool checksum = false;
+  int checkpointInterval = 0;
+  char *checkpointFile = NULL;
+  char const *restartFile = NULL;
+  bool profile = false;
+  char *tracePrefix = NULL;
   char *output = NULL;
   char *input = NULL;
   int ret = 0;
@@ -50,10 +166,32 @@ int main(int argc, char **argv) {
   static struct option const long_options[] =  {
     {"help",       no_argument,       0, 'h'},
     {"iterations", required_argument, 0, 'i'},
+    {"threads",    required_argument, 0, 't'},
+    {"ghost",      no_argument,       0, 'g'},
+    {"colour",     no_argument,       0, 'c'},
+    {"kernel",     required_argument, 0, 'k'},
+    {"temporal",   required_argument, 0, 'T'},
+    {"cache",      required_argument, 0, 'C'},
+    {"fuse",       required_argument, 0, 'f'},
+    {"tasks",      required_argument, 0, 'o'},
+    {"balance",    required_argument, 0, 'b'},
+    {"converge",   required_argument, 0, 's'},
+    {"compress",   no_argument,       0, 'z'},
+    {"shared",     no_argument,       0, 'S'},
+    {"checkpoint", required_argument, 0, 'K'},
+    {"checkpoint-file", required_argument, 0, 'F'},
+    {"restart",    required_argument, 0, 'R'},
+    {"mpiio",      no_argument,       0, 'm'},
+    {"synthetic",  required_argument, 0, 'y'},
+    {"seed",       required_argument, 0, 'e'},
+    {"checksum",   no_argument,       0, 'x'},
+    {"profile",    no_argument,       0, 'p'},
+    {"trace",      required_argument, 0, 'P'},
+    {"verify",     no_argument,       0, 'v'},
     {0, 0, 0, 0}
   };
 
-  static char const * short_options = "hi:";
+  static char const * short_options = "hi:t:gck:T:C:f:o:b:s:zSK:F:R:my:e:xpP:v";
   {
     char *endptr;
     int c;
@@ -70,26 +208,191 @@ int main(int argc, char **argv) {
             goto error_exit;
           }
           break;
+        case 't':
+          threads = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || threads < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          break;
+        case 'g':
+          ghost = true;
+          break;
+        case 'c':
+          channels = 3;
+          ghost = true;
+          break;
+        case 'k':
+          kernelNames = optarg;
+          break;
+        case 'T':
+          temporal = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || temporal < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          ghost = true;
+          break;
+        case 'C':
+          cache = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || cache < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          break;
+        case 'f':
+          fuseLength = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || fuseLength < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          fuse = true;
+          ghost = true;
+          break;
+        case 'o':
+          tasks = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || tasks < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          ghost = true;
+          break;
+        case 'b':
+          balance = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || balance < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          ghost = true;
+          break;
+        case 's':
+          converge = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || converge < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          ghost = true;
+          break;
+        case 'z':
+          compress = true;
+          ghost = true;
+          break;
+        case 'S':
+          sharedMemory = true;
+          ghost = true;
+          break;
+        case 'K':
+          checkpointInterval = strtol(optarg, &endptr, 10);
+          if (endptr == optarg || checkpointInterval < 1) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          ghost = true;
+          break;
+        case 'F':
+          checkpointFile = optarg;
+          break;
+        case 'R':
+          restartFile = optarg;
+          ghost = true;
+          break;
+        case 'm':
+          mpiio = true;
+          break;
+        case 'y':
+          synthetic = optarg;
+          if (parseSyntheticImage(synthetic, &syntheticWidth, &syntheticHeight, &syntheticPattern) != 0) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          mpiio = true;
+          break;
+        case 'e':
+          seed = strtoul(optarg, &endptr, 10);
+          if (endptr == optarg) {
+            help(argv[0], c, optarg);
+            goto error_exit;
+          }
+          break;
+        case 'x':
+          checksum = true;
+          mpiio = true;
+          break;
+        case 'p':
+          profile = true;
+          break;
+        case 'P':
+          tracePrefix = optarg;
+          profile = true;
+          break;
+        case 'v':
+          ret = (verifyFixedPointKernels(stdout) == 0) ? 0 : 1;
+          return ret;
         default:
           abort();
       }
     }
   }
 
-  if (argc <= (optind+1)) {
+  kernelPipeline *pipeline = newKernelPipeline(kernelNames);
+  if (pipeline == NULL) {
+    help(argv[0], 'k', kernelNames);
+    goto error_exit;
+  }
+  // Only tiles with ghost cells run several stages or the gradient magnitude
+  kernelEntry const *entry = pipeline->plans[0]->entry;
+  if (pipeline->stages > 1 || entry->kernel == NULL) {
+    ghost = true;
+  }
+
+  // Blocks advance several iterations at once, so a single unchanged
+  // iteration can not be seen
+  if (converge > 0 && temporal > 0) {
+    help(argv[0], 's', "can not be combined with --temporal");
+    goto error_exit;
+  }
+
+  // A fused round stands for many iterations, none of which is ever seen
+  // on its own
+  if (fuse && (temporal > 0 || converge > 0 || checkpointInterval > 0 || restartFile != NULL)) {
+    help(argv[0], 'f', "can not be combined with --temporal, --converge, --checkpoint or --restart");
+    goto error_exit;
+  }
+
+  // Task tiles exchange their own halos and can not move their borders yet
+  if (tasks > 0 && (temporal > 0 || fuse || balance > 0 || converge > 0 || compress || sharedMemory)) {
+    help(argv[0], 'o', "can not be combined with --temporal, --fuse, --balance, --converge, --compress or --shared");
+    goto error_exit;
+  }
+
+  // A synthetic image replaces <input-bmp>, the checksum <output-bmp>
+  if (argc - optind < (synthetic == NULL) + !checksum) {
     help(argv[0],' ',"Not enough arugments");
     goto error_exit;
   }
-  input = calloc(strlen(argv[optind]) + 1, sizeof(char));
-  strncpy(input, argv[optind], strlen(argv[optind]));
-  optind++;
+  if (synthetic == NULL) {
+    input = calloc(strlen(argv[optind]) + 1, sizeof(char));
+    strncpy(input, argv[optind], strlen(argv[optind]));
+    optind++;
+  }
 
-  output = calloc(strlen(argv[optind]) + 1, sizeof(char));
-  strncpy(output, argv[optind], strlen(argv[optind]));
-  optind++;
+  if (!checksum) {
+    output = calloc(strlen(argv[optind]) + 1, sizeof(char));
+    strncpy(output, argv[optind], strlen(argv[optind]));
+    optind++;
+  }
+
+  char defaultCheckpointFile[1024];
+  if (checkpointFile == NULL) {
+    snprintf(defaultCheckpointFile, sizeof(defaultCheckpointFile), "%s.ckpt",
+        (output != NULL) ? output : "checksum");
+    checkpointFile = defaultCheckpointFile;
+  }
 
-  // Initialize the MPI environment
-  MPI_Init(NULL, NULL);
+  // Initialize the MPI environment. Only the master thread communicates,
+  // the OpenMP team is used inside applyKernel
+  int provided;
+  MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
 
   int world_size;
   MPI_Comm_size(MPI_COMM_WORLD, &world_size);
@@ -97,27 +400,52 @@ int main(int argc, char **argv) {
   int world_rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 
+  if (provided < MPI_THREAD_FUNNELED && threads > 1) {
+    if (world_rank == 0) {
+      fprintf(stderr, "MPI does not support MPI_THREAD_FUNNELED, using one thread per rank\n");
+    }
+    threads = 1;
+  }
+  omp_set_num_threads(threads);
+
+  // Start the clocks of all ranks together, so their traces line up
+  if (profile) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    startTrace(world_rank, tracePrefix != NULL);
+  }
+  double traceStart = traceBegin();
+
+  int *kernel = (int *)entry->kernel;
+  int kernelSize = entry->dim;
+  float kernelFactor = entry->factor;
+
   // Pointer to the original image
   bmpImage *image = NULL;
 
-  // Load image in root process
-  if (world_rank == 0) {
+  // Load image in root process. With MPI-IO every rank reads its own tile
+  // later, so only the size is needed. A synthetic image is not loaded.
+  if (world_rank == 0 && synthetic == NULL) {
     image = newBmpImage(0, 0);
     if (image == NULL) {
       fprintf(stderr, "Could not allocate new image!\n");
     }
-    if (loadBmpImage(image, input) != 0) {
+    int loaded = mpiio ? loadBmpImageSizeOnly(image, input) : loadBmpImage(image, input);
+    if (loaded != 0) {
       fprintf(stderr, "Could not load bmp image '%s'!\n", input);
       freeBmpImage(image);
       goto error_exit;
     }
   }
+  traceEnd(TRACE_LOAD, -1, traceStart);
 
   // Buffer for distributing image size 
   int imageSize[2] = {};
 
   // Fill buffer in root process
-  if (world_rank == 0) {
+  if (synthetic != NULL) {
+    imageSize[0] = syntheticWidth;
+    imageSize[1] = syntheticHeight;
+  } else if (world_rank == 0) {
     imageSize[0] = image->width;
     imageSize[1] = image->height;
   }
@@ -127,26 +455,37 @@ int main(int argc, char **argv) {
 
   int imageWidth = imageSize[0];
   int imageHeight = imageSize[1];
+  if (mpiio && image != NULL) {
+    freeBmpImage(image);
+    image = NULL;
+  }
 
-  // Extract image channel in root process
+  // Extract image channel in root process. In colour the channel holds the
+  // blue, green and red values of every pixel interleaved.
   bmpImageChannel *imageChannel = NULL;
-  if (world_rank == 0) {
+  traceStart = traceBegin();
+  if (world_rank == 0 && !mpiio) {
     // Create a single color channel image. It is easier to work just with one color
-    imageChannel = newBmpImageChannel(imageWidth, imageHeight);
+    imageChannel = newBmpImageChannel(imageWidth * channels, imageHeight);
     if (imageChannel == NULL) {
       fprintf(stderr, "Could not allocate new image channel!\n");
       freeBmpImage(image);
       goto error_exit;
     }
 
+    if (channels > 1) {
+      for (unsigned int y = 0; y < imageHeight; y++) {
+        memcpy(imageChannel->data[y], image->data[y], imageWidth * sizeof(pixel));
+      }
     // Extract from the loaded image an average over all colors
-    if(extractImageChannel(imageChannel, image, extractAverage) != 0) {
+    } else if(extractImageChannel(imageChannel, image, extractAverage) != 0) {
       fprintf(stderr, "Could not extract image channel!\n");
       freeBmpImage(image);
       freeBmpImageChannel(imageChannel);
       goto error_exit;
     }
   } 
+  traceEnd(TRACE_LOAD, -1, traceStart);
 
   // Creates a grid out of the number of processes
   int gridHeight;
@@ -161,7 +500,38 @@ int main(int argc, char **argv) {
   int *rowSplit = calcSplit(gridHeight, imageHeight);
   int *colSplit = calcSplit(gridWidth, imageWidth);
 
-  // Process specific numbers
+  // A restart continues with the splits of the checkpoint if it was written
+  // on the same grid, otherwise the image is split anew
+  checkpointHeader *restart = NULL;
+  if (restartFile != NULL) {
+    restart = readCheckpointHeader(restartFile, MPI_COMM_WORLD);
+    if (restart == NULL) {
+      if (world_rank == 0) {
+        fprintf(stderr, "Could not read checkpoint '%s'!\n", restartFile);
+      }
+      goto error_exit;
+    }
+    if (restart->imageWidth != imageWidth || restart->imageHeight != imageHeight ||
+        restart->channels != channels) {
+      if (world_rank == 0) {
+        fprintf(stderr, "Checkpoint '%s' is of a %dx%d image with %d channels, not %dx%d with %d!\n",
+            restartFile, restart->imageWidth, restart->imageHeight, restart->channels,
+            imageWidth, imageHeight, channels);
+      }
+      goto error_exit;
+    }
+    if (restart->gridWidth == gridWidth && restart->gridHeight == gridHeight) {
+      memcpy(rowSplit, restart->rowSplit, gridHeight * sizeof(int));
+      memcpy(colSplit, restart->colSplit, gridWidth * sizeof(int));
+    }
+  }
+
+  // Scatter and gather count whole pixels
+  MPI_Datatype pixelType;
+  MPI_Type_contiguous(channels, MPI_BYTE, &pixelType);
+  MPI_Type_commit(&pixelType);
+
+  // Process specific numbers, in pixels
   int rowsToRecv = rowSplit[rankRowNumber];
   int colsToRecv = colSplit[rankColNumber];
   int bytesToRecv = rowsToRecv * colsToRecv;
@@ -169,19 +539,10 @@ int main(int argc, char **argv) {
   // Arrays needed by Scatterv
   int *bytesSplit = calloc(world_size, sizeof(int));
   int *displ = calloc(world_size, sizeof(int));
-  displ[0] = 0;
-  for (unsigned int r = 0; r < gridHeight; r++) {
-    for (unsigned int c = 0; c < gridWidth; c++) {
-      int rankNumber = r * gridWidth + c;
-      bytesSplit[rankNumber] = rowSplit[r] * colSplit[c];
-      if (rankNumber > 0) {
-        displ[rankNumber] = displ[rankNumber - 1] + bytesSplit[rankNumber - 1];
-      }
-    }
-  }
+  calcDisplacements(rowSplit, colSplit, gridWidth, gridHeight, bytesSplit, displ);
 
   // ImageChannel to be processed by each process
-  bmpImageChannel *subChannel = newBmpImageChannel(colsToRecv, rowsToRecv);
+  bmpImageChannel *subChannel = newBmpImageChannel(colsToRecv * channels, rowsToRecv);
 
   // Pointer to the data being sent
   unsigned char *sendPtr = NULL;
@@ -189,8 +550,9 @@ int main(int argc, char **argv) {
   // Since the displacement array requires each sub sqaure of the image to be
   // in contigious memory, we have to rearrange the image into a new buffer
   bmpImageChannel *sendChannel = NULL;
-  if (world_rank == 0) {
-    sendChannel = newBmpImageChannel(imageWidth, imageHeight);
+  traceStart = traceBegin();
+  if (world_rank == 0 && !mpiio) {
+    sendChannel = newBmpImageChannel(imageWidth * channels, imageHeight);
     unsigned char *insertPtr = sendChannel->rawdata;
 
     // Origin of the sub square in the original image
@@ -199,7 +561,7 @@ int main(int argc, char **argv) {
     for (unsigned int r = 0; r < gridHeight; r++) {
       xOrigin = 0;
       for (unsigned int c = 0; c < gridWidth; c++) {
-        int subWidth = colSplit[c];
+        int subWidth = colSplit[c] * channels;
         int subHeight = rowSplit[r];
 
         for (unsigned int y = 0; y < subHeight; y++) {
@@ -208,171 +570,671 @@ int main(int argc, char **argv) {
             insertPtr++; 
           }
         }
-        xOrigin += colSplit[c]; 
+        xOrigin += subWidth;
       }
       yOrigin += rowSplit[r];
     }
     sendPtr = sendChannel->rawdata;
   }
 
-  // Scatter the data to all processes
-  MPI_Scatterv(
-      sendPtr,
-      bytesSplit,
-      displ,
-      MPI_BYTE,
-      subChannel->rawdata,
-      bytesToRecv,
-      MPI_BYTE,
-      0,
-      MPI_COMM_WORLD
-      );
+  if (synthetic != NULL) {
+    // Every rank generates its own tile
+    traceStart = traceBegin();
+    generateSyntheticTile(
+        subChannel, channels, syntheticPattern, seed,
+        calcOffset(colSplit, rankColNumber), calcOffset(rowSplit, rankRowNumber),
+        imageWidth, imageHeight
+    );
+    traceEnd(TRACE_LOAD, -1, traceStart);
+  } else if (mpiio) {
+    // Every rank reads its own tile from the file
+    traceStart = traceBegin();
+    if (readBmpTile(
+          subChannel, channels, input,
+          calcOffset(colSplit, rankColNumber), calcOffset(rowSplit, rankRowNumber),
+          imageWidth, imageHeight, MPI_COMM_WORLD
+        ) != 0) {
+      if (world_rank == 0) {
+        fprintf(stderr, "Could not read tiles of bmp image '%s'!\n", input);
+      }
+      goto error_exit;
+    }
+    traceEnd(TRACE_LOAD, -1, traceStart);
+  } else {
+    // Scatter the data to all processes
+    MPI_Scatterv(
+        sendPtr,
+        bytesSplit,
+        displ,
+        pixelType,
+        subChannel->rawdata,
+        bytesToRecv,
+        pixelType,
+        0,
+        MPI_COMM_WORLD
+        );
+    traceEnd(TRACE_SCATTER, -1, traceStart);
+  }
   
 
-  // Allocate temporary storage after each iteration
-  bmpImageChannel *processImageChannel = newBmpImageChannel(subChannel->width, subChannel->height);
-  
-  int haloWidth = (kernelSize - 1) / 2 * HALO_COUNT;
-  // Struct with recieve buffers
-  imageHalo *recvHalo = newImageHalo(subChannel->width, subChannel->height, haloWidth);
-  imageHalo *sendHalo = newImageHalo(subChannel->width, subChannel->height, haloWidth);
-  
-  // Numbers of elements to send for east and west 
-  int hCount = haloWidth * recvHalo->height;
-
-  // Numbers of elements to send for north and south
-  int vCount = (recvHalo->width + 2*haloWidth) * haloWidth;
-
-  // Apply the kernel to the image for i iterations
-  for (int i = 0; i < iterations; i++) {
-
-    // Check if border exchange should be done
-    if (BORDER_EXCHANGE && HALO_COUNT > 0 && (i == 0 || i % HALO_COUNT == 0)) {
-      if (rankColNumber > 0) {
-        // Recv and send west
-        MPI_Recv(
-            recvHalo->rawwest,
-            hCount,
-            MPI_BYTE,
-            world_rank - 1,
-            0,
-            MPI_COMM_WORLD,
-            MPI_STATUS_IGNORE
-        );
-        createWestHalo(sendHalo->rawwest, sendHalo->count, subChannel);
-        MPI_Send(
-            sendHalo->rawwest,
-            hCount,
-            MPI_BYTE,
-            world_rank - 1,
-            0,
-            MPI_COMM_WORLD
-        );
+  if (ghost) {
+    // Fused iterations run in rounds of one composed kernel of --fuse
+    // iterations each. The round length sets how often the cells outside
+    // the image are reset, so it is given rather than taken from the tiles,
+    // and the result does not depend on the grid.
+    kernelPipeline const *stages = pipeline;
+    kernelPipeline *fused = NULL;
+    kernelPipeline *fusedLast = NULL;
+    int rounds = iterations;
+    if (fuse && iterations > 0) {
+      char const *obstacle = fusionObstacle(pipeline);
+      if (obstacle == NULL) {
+        int minWidth = imageWidth;
+        int minHeight = imageHeight;
+        for (int r = 0; r < gridHeight; r++) {
+          minHeight = (rowSplit[r] < minHeight) ? rowSplit[r] : minHeight;
+        }
+        for (int c = 0; c < gridWidth; c++) {
+          minWidth = (colSplit[c] < minWidth) ? colSplit[c] : minWidth;
+        }
+        int perRound = (fuseLength > (int)iterations) ? (int)iterations : fuseLength;
+        int depth = perRound * pipeline->radius;
+        if (depth > minWidth || depth > minHeight) {
+          if (world_rank == 0) {
+            fprintf(stderr, "Rounds of %d iterations need a halo of %d, deeper than the smallest %dx%d tile!\n",
+                perRound, depth, minWidth, minHeight);
+          }
+          goto error_exit;
+        }
+        int fusedRounds = (iterations + perRound - 1) / perRound;
+        int last = iterations - (fusedRounds - 1) * perRound;
+        fused = fuseKernelPipeline(pipeline, perRound, minWidth, minHeight);
+        if (fused != NULL && last != perRound) {
+          fusedLast = fuseKernelPipeline(pipeline, last, minWidth, minHeight);
+        }
+        if (fused == NULL || (last != perRound && fusedLast == NULL)) {
+          obstacle = "the composed kernel is too large";
+          freeKernelPipeline(fused);
+          fused = NULL;
+        } else {
+          stages = fused;
+          rounds = fusedRounds;
+          if (world_rank == 0) {
+            printf("Fusion:      %d iterations in %d rounds of %d, the last of %d\n",
+                iterations, rounds, perRound, last);
+          }
+        }
+      }
+      if (obstacle != NULL && world_rank == 0) {
+        printf("Fusion:      not done, %s\n", obstacle);
       }
+    }
+
+    // With temporal blocking the halo is exchanged every <depth> iterations
+    int haloCount = (temporal > 0) ? temporal : HALO_COUNT;
+    int kernelRadius = stages->radius;
+    int haloWidth = kernelRadius * haloCount;
+    if (haloWidth > colsToRecv || haloWidth > rowsToRecv) {
+      fprintf(stderr, "Rank %d: halo of %d is deeper than the %dx%d tile!\n",
+          world_rank, haloWidth, colsToRecv, rowsToRecv);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Tiles with the halo stored in-line as ghost rows and columns
+    imageTile *tile = newImageTile(colsToRecv, rowsToRecv, haloWidth, channels);
+    imageTile *processTile = newImageTile(colsToRecv, rowsToRecv, haloWidth, channels);
+    copyChannelToTile(tile, subChannel);
 
-      if (rankColNumber < gridWidth - 1) {
-        // Send and recv east
-        createEastHalo(sendHalo->raweast, sendHalo->count, subChannel);
-        MPI_Send(
-            sendHalo->raweast,
-            hCount,
-            MPI_BYTE,
-            world_rank + 1,
-            0,
+    if (world_rank == 0) {
+      printKernelPipeline(stdout, stages);
+    }
+
+    // The ghost cells of the checkpoint are received with the first exchange
+    int first = 0;
+    if (restart != NULL) {
+      traceStart = traceBegin();
+      if (readCheckpointTile(
+            tile, restartFile, restart,
+            calcOffset(colSplit, rankColNumber), calcOffset(rowSplit, rankRowNumber),
             MPI_COMM_WORLD
-        );
-        MPI_Recv(
-            recvHalo->raweast,
-            hCount,
-            MPI_BYTE,
-            world_rank + 1,
-            0,
-            MPI_COMM_WORLD,
-            MPI_STATUS_IGNORE
-        );
+          ) != 0) {
+        if (world_rank == 0) {
+          fprintf(stderr, "Could not read tiles of checkpoint '%s'!\n", restartFile);
+        }
+        goto error_exit;
+      }
+      traceEnd(TRACE_CHECKPOINT, -1, traceStart);
+      first = (restart->iteration < iterations) ? restart->iteration : iterations;
+      if (world_rank == 0) {
+        printf("Restart:     from iteration %d of '%s'\n", restart->iteration, restartFile);
       }
+    }
 
-      if (rankRowNumber > 0) {
-        // Recv and send north
-        MPI_Recv(
-            recvHalo->rawnorth,
-            vCount,
-            MPI_BYTE,
-            world_rank - gridWidth,
-            0,
-            MPI_COMM_WORLD,
-            MPI_STATUS_IGNORE
-        );
-        createNorthHalo(sendHalo->rawnorth, sendHalo->count, subChannel, recvHalo);
-        MPI_Send(
-            sendHalo->rawnorth,
-            vCount,
-            MPI_BYTE,
-            world_rank - gridWidth,
-            0,
-            MPI_COMM_WORLD
-        );
+    tileExchange *exchange = newGridExchange(tile, world_rank, gridWidth, gridHeight);
+
+    // Task tiles have frames of their own, the tile of the rank only holds
+    // the state for checkpoints and the result
+    taskGrid *taskTiles = NULL;
+    if (tasks > 0) {
+      int tilesX;
+      int tilesY;
+      createImageGrid(tasks, &tilesX, &tilesY);
+      taskTiles = newTaskGrid(
+          colsToRecv, rowsToRecv, haloWidth, channels, tilesX, tilesY,
+          world_rank, gridWidth, gridHeight, MPI_COMM_WORLD
+      );
+      if (taskTiles == NULL) {
+        fprintf(stderr, "Rank %d: halo of %d is deeper than the %dx%d task tiles of the %dx%d tile!\n",
+            world_rank, haloWidth, tilesX, tilesY, colsToRecv, rowsToRecv);
+        MPI_Abort(MPI_COMM_WORLD, 1);
       }
+      copyTileToTaskGrid(taskTiles, tile);
+    }
 
-      if (rankRowNumber < gridHeight - 1) {
-        // Send and recv south
-        createSouthHalo(sendHalo->rawsouth, sendHalo->count, subChannel, recvHalo);
-        MPI_Send(
-            sendHalo->rawsouth,
-            vCount,
-            MPI_BYTE,
-            world_rank + gridWidth,
-            0,
-            MPI_COMM_WORLD
-        );
-        MPI_Recv(
-            recvHalo->rawsouth,
-            vCount,
-            MPI_BYTE,
-            world_rank + gridWidth,
-            0,
-            MPI_COMM_WORLD,
-            MPI_STATUS_IGNORE
-        );
+    // Both frames move into a window shared with the ranks on the node
+    sharedTiles *shared = NULL;
+    if (sharedMemory) {
+      shared = shareImageTiles(&tile, &processTile, exchange);
+    }
+
+    haloCodec *codec = compress ? newHaloCodec() : NULL;
+    if (compress && codec == NULL) {
+      fprintf(stderr, "Rank %d: could not allocate the halo codec!\n", world_rank);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    temporalBlocking *blocking = NULL;
+    if (temporal > 0) {
+      blocking = newTemporalBlocking(tile, temporal, kernelRadius, cache * 1024);
+    }
+
+    // Compute time of every rank since the last rebalancing
+    double computeTime = 0;
+    double *times = NULL;
+    int *oldRowSplit = NULL;
+    int *oldColSplit = NULL;
+    int lastBalance = first;
+    int rebalances = 0;
+    if (balance > 0) {
+      times = calloc(world_size, sizeof(double));
+      oldRowSplit = calloc(gridHeight, sizeof(int));
+      oldColSplit = calloc(gridWidth, sizeof(int));
+    }
+
+    // Bytes of the tile that changed in the last computed iteration, or -1
+    // if unknown, and the iteration since which the tile has not changed
+    long changes = -1;
+    int stableSince = -1;
+    int skipped = 0;
+    int executed = iterations;
+
+    // Checkpoints written and the time spent writing them
+    int lastCheckpoint = first;
+    int checkpoints = 0;
+    double checkpointTime = 0;
+
+    for (int i = first; i < rounds; i++) {
+      int step = (i - first) % haloCount;
+
+      // The tile borders can only move while the halo is about to be
+      // exchanged anyway
+      if (balance > 0 && step == 0 && i - lastBalance >= balance) {
+        traceStart = traceBegin();
+        MPI_Allgather(&computeTime, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, MPI_COMM_WORLD);
+        memcpy(oldRowSplit, rowSplit, gridHeight * sizeof(int));
+        memcpy(oldColSplit, colSplit, gridWidth * sizeof(int));
+        int minCells = (haloWidth > 1) ? haloWidth : 1;
+        if (balanceSplits(rowSplit, colSplit, gridWidth, gridHeight, times, minCells, BALANCE_THRESHOLD)) {
+          imageTile *moved = migrateTile(
+              tile, oldRowSplit, oldColSplit, rowSplit, colSplit,
+              gridWidth, world_rank, MPI_COMM_WORLD
+          );
+          if (shared != NULL) {
+            freeSharedTiles(shared);
+          } else {
+            freeImageTile(tile);
+            freeImageTile(processTile);
+          }
+          tile = moved;
+          rowsToRecv = rowSplit[rankRowNumber];
+          colsToRecv = colSplit[rankColNumber];
+          processTile = newImageTile(colsToRecv, rowsToRecv, haloWidth, channels);
+          freeTileExchange(exchange);
+          exchange = newGridExchange(tile, world_rank, gridWidth, gridHeight);
+          if (shared != NULL) {
+            shared = shareImageTiles(&tile, &processTile, exchange);
+          }
+          rebalances++;
+          changes = -1;
+        }
+        computeTime = 0;
+        lastBalance = i;
+        traceEnd(TRACE_BALANCE, i, traceStart);
+      }
+
+      // Right before the exchange the inside of the tiles is the whole state
+      if (checkpointInterval > 0 && step == 0 && i - lastCheckpoint >= checkpointInterval) {
+        traceStart = traceBegin();
+        double start = MPI_Wtime();
+        if (taskTiles != NULL) {
+          copyTaskGridToTile(tile, taskTiles);
+        }
+        if (writeCheckpoint(
+              checkpointFile, tile, i, imageWidth, imageHeight,
+              rowSplit, colSplit, gridWidth, gridHeight, MPI_COMM_WORLD
+            ) != 0) {
+          if (world_rank == 0) {
+            fprintf(stderr, "Could not write checkpoint '%s' at iteration %d!\n", checkpointFile, i);
+          }
+        } else {
+          checkpoints++;
+        }
+        checkpointTime += MPI_Wtime() - start;
+        lastCheckpoint = i;
+        traceEnd(TRACE_CHECKPOINT, i, traceStart);
+      }
+
+      // Task tiles exchange their halos and compute as one
+      if (taskTiles != NULL) {
+        applyTaskGrid(taskTiles, stages, i);
+        continue;
+      }
+
+      // The halo is packed by the datatypes inside MPI
+      if (BORDER_EXCHANGE && step == 0) {
+        traceStart = traceBegin();
+        if (shared != NULL) {
+          exchangeSharedHalo(shared, tile);
+        } else if (codec != NULL) {
+          if (exchangeTileHaloCompressed(tile, exchange, codec) != 0) {
+            fprintf(stderr, "Rank %d: could not allocate the buffers of the halo codec!\n", world_rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+          }
+        } else {
+          exchangeTileHalo(tile, exchange);
+        }
+        traceEnd(TRACE_WAIT, i, traceStart);
+      }
+
+      traceStart = traceBegin();
+      double start = MPI_Wtime();
+      if (blocking != NULL) {
+        // Advance the tile block by block to the next halo exchange
+        int steps = (iterations - i < haloCount) ? iterations - i : haloCount;
+        applyTemporalBlocks(processTile, tile, exchange, steps, pipeline, blocking);
+        swapImageTile(&processTile, &tile);
+        computeTime += MPI_Wtime() - start;
+        traceEnd(TRACE_COMPUTE, i, traceStart);
+        i += steps - 1;
+        continue;
+      }
+
+      // A tile that did not change in the last iteration and received the
+      // same halo again would compute the same result. processTile still
+      // holds the input of that iteration, ghost cells included.
+      bool skipTile = converge > 0 && haloCount == 1 && changes == 0 &&
+          equalTileGhosts(tile, processTile);
+
+      if (skipTile) {
+        skipped++;
+      } else {
+        // Ghost cells shared with a neighbour are computed as well, as long as
+        // they are still valid, so that the halo is only exchanged every
+        // haloCount iterations. Ghost cells outside the image stay zero.
+        int extend = kernelRadius * (haloCount - 1 - step);
+        tileRegion region = {
+          .x0 = (exchange->west != MPI_PROC_NULL) ? -extend : 0,
+          .x1 = colsToRecv + ((exchange->east != MPI_PROC_NULL) ? extend : 0),
+          .y0 = (exchange->north != MPI_PROC_NULL) ? -extend : 0,
+          .y1 = rowsToRecv + ((exchange->south != MPI_PROC_NULL) ? extend : 0),
+        };
+        tileRegion limit = {
+          .x0 = (exchange->west != MPI_PROC_NULL) ? -haloWidth : 0,
+          .x1 = colsToRecv + ((exchange->east != MPI_PROC_NULL) ? haloWidth : 0),
+          .y0 = (exchange->north != MPI_PROC_NULL) ? -haloWidth : 0,
+          .y1 = rowsToRecv + ((exchange->south != MPI_PROC_NULL) ? haloWidth : 0),
+        };
+        kernelPipeline const *round = (i == rounds - 1 && fusedLast != NULL) ? fusedLast : stages;
+        applyKernelPipeline(processTile, tile, &region, &limit, round);
+        if (converge > 0) {
+          changes = countTileChanges(processTile, tile);
+        }
+        swapImageTile(&processTile, &tile);
+      }
+      computeTime += MPI_Wtime() - start;
+      traceEnd(TRACE_COMPUTE, i, traceStart);
+
+      if (converge > 0) {
+        if (changes > 0) {
+          stableSince = -1;
+        } else if (stableSince < 0) {
+          stableSince = i;
+        }
+
+        // Once no pixel changes anywhere, every further iteration gives the
+        // same image
+        if ((i + 1) % converge == 0) {
+          long anyChanges;
+          MPI_Allreduce(&changes, &anyChanges, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+          if (anyChanges == 0) {
+            executed = i + 1;
+            break;
+          }
+        }
       }
     }
-    
-    // Apply kernel
-    applyKernel(
-      processImageChannel->data,
-      subChannel->data,
-      sendHalo,
-      recvHalo,
-      kernel,
-      kernelSize,
-      kernelFactor
-    );
 
-    // Swap channel and halo
-    swapImageChannel(&processImageChannel, &subChannel);
-    swapHalo(&sendHalo, &recvHalo);
+    if (converge > 0) {
+      int *stable = (world_rank == 0) ? calloc(world_size, sizeof(int)) : NULL;
+      int totalSkipped = 0;
+      MPI_Gather(&stableSince, 1, MPI_INT, stable, 1, MPI_INT, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&skipped, &totalSkipped, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (world_rank == 0) {
+        if (executed < iterations) {
+          printf("Converged:   stopped after %d of %d iterations\n", executed, iterations);
+        } else {
+          printf("Converged:   no, ran all %d iterations\n", iterations);
+        }
+        printf("Skipped:     %d tile iterations\n", totalSkipped);
+        printf("Stable:      iteration since which every tile is unchanged (- if never)\n");
+        for (int r = 0; r < gridHeight; r++) {
+          printf("            ");
+          for (int c = 0; c < gridWidth; c++) {
+            if (stable[r * gridWidth + c] < 0) {
+              printf(" %6s", "-");
+            } else {
+              printf(" %6d", stable[r * gridWidth + c]);
+            }
+          }
+          printf("\n");
+        }
+        free(stable);
+      }
+    }
+
+    if (checkpoints > 0 && world_rank == 0) {
+      double gigabytes = (double)imageWidth * imageHeight * channels / 1e9;
+      printf("Checkpoint:  %d written to '%s', %.3f s for %.3f GB each, %.3f s per GB\n",
+          checkpoints, checkpointFile, checkpointTime / checkpoints, gigabytes,
+          checkpointTime / checkpoints / gigabytes);
+    }
+
+    if (balance > 0) {
+      if (world_rank == 0) {
+        printf("Balance:     %d rebalances, rows", rebalances);
+        for (int r = 0; r < gridHeight; r++) {
+          printf(" %d", rowSplit[r]);
+        }
+        printf(", columns");
+        for (int c = 0; c < gridWidth; c++) {
+          printf(" %d", colSplit[c]);
+        }
+        printf("\n");
+      }
+      free(times);
+      free(oldRowSplit);
+      free(oldColSplit);
+    }
+
+    // The sub image follows the tile if its borders have moved
+    if (rebalances > 0) {
+      freeBmpImageChannel(subChannel);
+      subChannel = newBmpImageChannel(colsToRecv * channels, rowsToRecv);
+      bytesToRecv = rowsToRecv * colsToRecv;
+      calcDisplacements(rowSplit, colSplit, gridWidth, gridHeight, bytesSplit, displ);
+    }
+
+    if (blocking != NULL) {
+      double traffic[3] = {blocking->bytes, blocking->untiledBytes, blocking->pixelIterations};
+      double total[3];
+      MPI_Reduce(traffic, total, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (world_rank == 0 && total[2] > 0) {
+        printf("Temporal:    %d iterations on blocks of %dx%d\n",
+            temporal, blocking->blockWidth, blocking->blockHeight);
+        printf("Traffic:     %.3f bytes per pixel-iteration (%.3f without blocking)\n",
+            total[0] / total[2], total[1] / total[2]);
+      }
+      freeTemporalBlocking(blocking);
+    }
+
+    if (codec != NULL) {
+      double sent[3] = {codec->rawBytes, codec->sentBytes, codec->compressed};
+      double total[3];
+      int messages = 0;
+      MPI_Reduce(sent, total, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&codec->messages, &messages, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (world_rank == 0 && total[0] > 0) {
+        printf("Halo codec:  %.0f of %.0f bytes sent (%.1f%%), %.0f of %d messages run-length coded\n",
+            total[1], total[0], 100.0 * total[1] / total[0], total[2], messages);
+      }
+      freeHaloCodec(codec);
+    }
+
+    if (taskTiles != NULL) {
+      int perIteration[2] = {taskTiles->receives, taskTiles->copies};
+      int total[2];
+      MPI_Reduce(perIteration, total, 2, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (world_rank == 0) {
+        printf("Tasks:       %dx%d tiles per rank, %d halo messages and %d copies per iteration\n",
+            taskTiles->tilesX, taskTiles->tilesY, total[0], total[1]);
+      }
+      copyTaskGridToTile(tile, taskTiles);
+      freeTaskGrid(taskTiles);
+    }
+
+    copyTileToChannel(subChannel, tile);
+    freeKernelPipeline(fused);
+    freeKernelPipeline(fusedLast);
+    freeTileExchange(exchange);
+    if (shared != NULL) {
+      freeSharedTiles(shared);
+    } else {
+      freeImageTile(processTile);
+      freeImageTile(tile);
+    }
+  } else {
+    // Allocate temporary storage after each iteration
+    bmpImageChannel *processImageChannel = newBmpImageChannel(subChannel->width, subChannel->height);
+
+    int haloWidth = (kernelSize - 1) / 2 * HALO_COUNT;
+    // Struct with recieve buffers
+    imageHalo *recvHalo = newImageHalo(subChannel->width, subChannel->height, haloWidth);
+    imageHalo *sendHalo = newImageHalo(subChannel->width, subChannel->height, haloWidth);
+
+    // Numbers of elements to send for east and west 
+    int hCount = haloWidth * recvHalo->height;
+
+    // Numbers of elements to send for north and south
+    int vCount = (recvHalo->width + 2*haloWidth) * haloWidth;
+
+    // Apply the kernel to the image for i iterations
+    for (int i = 0; i < iterations; i++) {
+
+      // Check if border exchange should be done
+      if (BORDER_EXCHANGE && HALO_COUNT > 0 && (i == 0 || i % HALO_COUNT == 0)) {
+        if (rankColNumber > 0) {
+          // Recv and send west
+          traceStart = traceBegin();
+          MPI_Recv(
+              recvHalo->rawwest,
+              hCount,
+              MPI_BYTE,
+              world_rank - 1,
+              0,
+              MPI_COMM_WORLD,
+              MPI_STATUS_IGNORE
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+          traceStart = traceBegin();
+          createWestHalo(sendHalo->rawwest, sendHalo->count, subChannel);
+          traceEnd(TRACE_PACK, i, traceStart);
+          traceStart = traceBegin();
+          MPI_Send(
+              sendHalo->rawwest,
+              hCount,
+              MPI_BYTE,
+              world_rank - 1,
+              0,
+              MPI_COMM_WORLD
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+        }
+
+        if (rankColNumber < gridWidth - 1) {
+          // Send and recv east
+          traceStart = traceBegin();
+          createEastHalo(sendHalo->raweast, sendHalo->count, subChannel);
+          traceEnd(TRACE_PACK, i, traceStart);
+          traceStart = traceBegin();
+          MPI_Send(
+              sendHalo->raweast,
+              hCount,
+              MPI_BYTE,
+              world_rank + 1,
+              0,
+              MPI_COMM_WORLD
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+          traceStart = traceBegin();
+          MPI_Recv(
+              recvHalo->raweast,
+              hCount,
+              MPI_BYTE,
+              world_rank + 1,
+              0,
+              MPI_COMM_WORLD,
+              MPI_STATUS_IGNORE
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+        }
+
+        if (rankRowNumber > 0) {
+          // Recv and send north
+          traceStart = traceBegin();
+          MPI_Recv(
+              recvHalo->rawnorth,
+              vCount,
+              MPI_BYTE,
+              world_rank - gridWidth,
+              0,
+              MPI_COMM_WORLD,
+              MPI_STATUS_IGNORE
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+          traceStart = traceBegin();
+          createNorthHalo(sendHalo->rawnorth, sendHalo->count, subChannel, recvHalo);
+          traceEnd(TRACE_PACK, i, traceStart);
+          traceStart = traceBegin();
+          MPI_Send(
+              sendHalo->rawnorth,
+              vCount,
+              MPI_BYTE,
+              world_rank - gridWidth,
+              0,
+              MPI_COMM_WORLD
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+        }
+
+        if (rankRowNumber < gridHeight - 1) {
+          // Send and recv south
+          traceStart = traceBegin();
+          createSouthHalo(sendHalo->rawsouth, sendHalo->count, subChannel, recvHalo);
+          traceEnd(TRACE_PACK, i, traceStart);
+          traceStart = traceBegin();
+          MPI_Send(
+              sendHalo->rawsouth,
+              vCount,
+              MPI_BYTE,
+              world_rank + gridWidth,
+              0,
+              MPI_COMM_WORLD
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+          traceStart = traceBegin();
+          MPI_Recv(
+              recvHalo->rawsouth,
+              vCount,
+              MPI_BYTE,
+              world_rank + gridWidth,
+              0,
+              MPI_COMM_WORLD,
+              MPI_STATUS_IGNORE
+          );
+          traceEnd(TRACE_WAIT, i, traceStart);
+        }
+      }
+
+      // Apply kernel
+      traceStart = traceBegin();
+      applyKernel(
+        processImageChannel->data,
+        subChannel->data,
+        sendHalo,
+        recvHalo,
+        kernel,
+        kernelSize,
+        kernelFactor
+      );
+
+      traceEnd(TRACE_COMPUTE, i, traceStart);
+
+      // Swap channel and halo
+      swapImageChannel(&processImageChannel, &subChannel);
+      swapHalo(&sendHalo, &recvHalo);
+    }
+    freeBmpImageChannel(processImageChannel);
+    freeImageHalo(recvHalo);
+    freeImageHalo(sendHalo);
+  }
+
+  if (checksum) {
+    // The checksums of the tiles add up to the checksum of the image
+    traceStart = traceBegin();
+    uint64_t tileChecksum = checksumTile(
+        subChannel, channels,
+        calcOffset(colSplit, rankColNumber), calcOffset(rowSplit, rankRowNumber), imageWidth
+    );
+    uint64_t imageChecksum = 0;
+    MPI_Reduce(&tileChecksum, &imageChecksum, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (world_rank == 0) {
+      printf("Checksum:    %016llx (%dx%d, %d channels)\n",
+          (unsigned long long)imageChecksum, imageWidth, imageHeight, channels);
+    }
+    traceEnd(TRACE_SAVE, -1, traceStart);
+  } else if (mpiio) {
+    // Every rank writes its own tile, the tile borders may have moved
+    traceStart = traceBegin();
+    if (writeBmpTile(
+          subChannel, channels, output,
+          calcOffset(colSplit, rankColNumber), calcOffset(rowSplit, rankRowNumber),
+          imageWidth, imageHeight, MPI_COMM_WORLD
+        ) != 0) {
+      if (world_rank == 0) {
+        fprintf(stderr, "Could not save output to '%s'!\n", output);
+      }
+      goto error_exit;
+    }
+    traceEnd(TRACE_SAVE, -1, traceStart);
+  } else {
+    // Gather the result into the root process
+    traceStart = traceBegin();
+    MPI_Gatherv(
+      subChannel->rawdata, 
+      bytesToRecv,
+      pixelType,
+      sendPtr,
+      bytesSplit,
+      displ,
+      pixelType,
+      0,
+      MPI_COMM_WORLD
+    );
   }
-  freeBmpImageChannel(processImageChannel);
-
-  // Gather the result into the root process
-  MPI_Gatherv(
-    subChannel->rawdata, 
-    bytesToRecv,
-    MPI_BYTE,
-    sendPtr,
-    bytesSplit,
-    displ,
-    MPI_BYTE,
-    0,
-    MPI_COMM_WORLD
-  );
-  
-  freeImageHalo(recvHalo);
-  freeImageHalo(sendHalo);
 
   // Whole image gathered is stored such that each process'
   // sub image
-  if (world_rank == 0) {
+  if (world_rank == 0 && !mpiio) {
     unsigned char *recvPtr = sendPtr;
 
     // Origin of the sub square in the original image
@@ -381,7 +1243,7 @@ int main(int argc, char **argv) {
     for (unsigned int r = 0; r < gridHeight; r++) {
       xOrigin = 0;
       for (unsigned int c = 0; c < gridWidth; c++) {
-        int subWidth = colSplit[c];
+        int subWidth = colSplit[c] * channels;
         int subHeight = rowSplit[r];
 
         for (unsigned int y = 0; y < subHeight; y++) {
@@ -390,17 +1252,25 @@ int main(int argc, char **argv) {
             recvPtr++; 
           }
         }
-        xOrigin += colSplit[c]; 
+        xOrigin += subWidth;
       }
       yOrigin += rowSplit[r];
     }
     freeBmpImageChannel(sendChannel);
   }
+  if (!mpiio) {
+    traceEnd(TRACE_GATHER, -1, traceStart);
+  }
 
   // In the root process map and save the received image
-  if (world_rank == 0) {
+  traceStart = traceBegin();
+  if (world_rank == 0 && !mpiio) {
+    if (channels > 1) {
+      for (unsigned int y = 0; y < imageHeight; y++) {
+        memcpy(image->data[y], imageChannel->data[y], imageWidth * sizeof(pixel));
+      }
     // Map our single color image back to a normal BMP image with 3 color channels
-    if (mapImageChannel(image, imageChannel, mapEqual) != 0) {
+    } else if (mapImageChannel(image, imageChannel, mapEqual) != 0) {
       fprintf(stderr, "Could not map image channel!\n");
       freeBmpImage(image);
       freeBmpImageChannel(imageChannel);
@@ -417,7 +1287,23 @@ int main(int argc, char **argv) {
     freeBmpImageChannel(imageChannel);
   }
 
+  if (!mpiio) {
+    traceEnd(TRACE_SAVE, -1, traceStart);
+  }
+
+  if (profile) {
+    reportTrace(stdout, MPI_COMM_WORLD);
+    if (tracePrefix != NULL && writeTrace(tracePrefix) != 0) {
+      fprintf(stderr, "Rank %d: could not write trace '%s.%d.json'!\n",
+          world_rank, tracePrefix, world_rank);
+    }
+    stopTrace();
+  }
+
   // Free all allocated memory
+  freeKernelPipeline(pipeline);
+  freeCheckpointHeader(restart);
+  MPI_Type_free(&pixelType);
   freeBmpImageChannel(subChannel);
   free(rowSplit);
   free(colSplit);
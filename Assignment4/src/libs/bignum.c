@@ -0,0 +1,233 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bignum.h"
+
+unsigned int bigLimbsFor(unsigned int bits) {
+	return 1 + (bits + 31) / 32;
+}
+
+bigFixed *newBigFixed(unsigned int limbs) {
+	bigFixed *a = malloc(sizeof(bigFixed));
+	if (a == NULL) {
+		return NULL;
+	}
+	a->limbs = limbs;
+	a->digit = calloc(limbs, sizeof(uint32_t));
+	if (a->digit == NULL) {
+		free(a);
+		return NULL;
+	}
+	return a;
+}
+
+void freeBigFixed(bigFixed *a) {
+	if (a == NULL) {
+		return;
+	}
+	free(a->digit);
+	free(a);
+}
+
+void bigCopy(bigFixed *to, bigFixed const *from) {
+	memcpy(to->digit, from->digit, to->limbs * sizeof(uint32_t));
+}
+
+static int negative(uint32_t const *digit, unsigned int limbs) {
+	return digit[limbs - 1] >> 31;
+}
+
+static void negate(uint32_t *digit, unsigned int limbs) {
+	uint64_t carry = 1;
+	for (unsigned int i = 0; i < limbs; i++) {
+		uint64_t sum = (uint64_t) (uint32_t) ~digit[i] + carry;
+		digit[i] = (uint32_t) sum;
+		carry = sum >> 32;
+	}
+}
+
+// digit = digit * factor + addend, returns what overflowed the last limb
+static uint32_t multiplySmall(uint32_t *digit, unsigned int limbs, uint32_t factor, uint32_t addend) {
+	uint64_t carry = addend;
+	for (unsigned int i = 0; i < limbs; i++) {
+		uint64_t product = (uint64_t) digit[i] * factor + carry;
+		digit[i] = (uint32_t) product;
+		carry = product >> 32;
+	}
+	return (uint32_t) carry;
+}
+
+static void divideSmall(uint32_t *digit, unsigned int limbs, uint32_t divisor) {
+	uint64_t remainder = 0;
+	for (unsigned int i = limbs; i-- > 0;) {
+		uint64_t current = (remainder << 32) | digit[i];
+		digit[i] = (uint32_t) (current / divisor);
+		remainder = current % divisor;
+	}
+}
+
+// Decimal number with an optional sign, fraction and exponent, e.g.
+// -0.7436438870371587047521915061147 or 1.5e-3. Returns 1 if it is not one
+// or does not fit.
+int bigFromString(bigFixed *to, char const *string) {
+	unsigned int const limbs = to->limbs;
+	char const *s = string;
+	int sign = 0;
+	while (isspace((unsigned char) *s)) {
+		s++;
+	}
+	if (*s == '-' || *s == '+') {
+		sign = (*s == '-');
+		s++;
+	}
+
+	char const *integer = s;
+	while (isdigit((unsigned char) *s)) {
+		s++;
+	}
+	char const *integerEnd = s;
+	char const *fraction = s;
+	char const *fractionEnd = s;
+	if (*s == '.') {
+		fraction = ++s;
+		while (isdigit((unsigned char) *s)) {
+			s++;
+		}
+		fractionEnd = s;
+	}
+	if (integer == integerEnd && fraction == fractionEnd) {
+		return 1;
+	}
+	long exponent = 0;
+	if (*s == 'e' || *s == 'E') {
+		char *end;
+		exponent = strtol(s + 1, &end, 10);
+		if (end == s + 1) {
+			return 1;
+		}
+		s = end;
+	}
+	if (*s != '\0') {
+		return 1;
+	}
+
+	// The fraction is divided in from its last digit, the integer digits
+	// are multiplied in on top
+	memset(to->digit, 0, limbs * sizeof(uint32_t));
+	for (char const *d = fractionEnd; d-- > fraction;) {
+		to->digit[limbs - 1] += *d - '0';
+		divideSmall(to->digit, limbs, 10);
+	}
+	uint32_t *whole = calloc(limbs, sizeof(uint32_t));
+	if (whole == NULL) {
+		return 1;
+	}
+	int overflow = 0;
+	for (char const *d = integer; d < integerEnd; d++) {
+		overflow |= multiplySmall(&whole[limbs - 1], 1, 10, *d - '0') != 0;
+	}
+	overflow |= whole[limbs - 1] >> 31;
+	to->digit[limbs - 1] += whole[limbs - 1];
+	free(whole);
+
+	for (; exponent > 0 && !overflow; exponent--) {
+		overflow |= multiplySmall(to->digit, limbs, 10, 0) != 0 || negative(to->digit, limbs);
+	}
+	for (; exponent < 0; exponent++) {
+		divideSmall(to->digit, limbs, 10);
+	}
+	if (overflow) {
+		return 1;
+	}
+	if (sign) {
+		negate(to->digit, limbs);
+	}
+	return 0;
+}
+
+void bigFromDouble(bigFixed *to, double value) {
+	unsigned int const limbs = to->limbs;
+	double v = fabs(value);
+	double whole = floor(v);
+	to->digit[limbs - 1] = (uint32_t) whole;
+	v -= whole;
+	for (unsigned int i = limbs - 1; i-- > 0;) {
+		v *= 4294967296.0;
+		whole = floor(v);
+		to->digit[i] = (uint32_t) whole;
+		v -= whole;
+	}
+	if (value < 0) {
+		negate(to->digit, limbs);
+	}
+}
+
+// The magnitude of a negative number is its complement plus one unit of the
+// last limb, which does not matter in double precision
+double bigToDouble(bigFixed const *a) {
+	unsigned int const limbs = a->limbs;
+	uint32_t const flip = negative(a->digit, limbs) ? 0xffffffffu : 0;
+	double value = 0;
+	int used = 0;
+	for (unsigned int i = limbs; i-- > 0 && used < 3;) {
+		uint32_t digit = a->digit[i] ^ flip;
+		value += ldexp((double) digit, 32 * ((int) i - (int) limbs + 1));
+		used += (value != 0);
+	}
+	return flip ? -value : value;
+}
+
+void bigAdd(bigFixed *result, bigFixed const *a, bigFixed const *b) {
+	uint64_t carry = 0;
+	for (unsigned int i = 0; i < result->limbs; i++) {
+		uint64_t sum = (uint64_t) a->digit[i] + b->digit[i] + carry;
+		result->digit[i] = (uint32_t) sum;
+		carry = sum >> 32;
+	}
+}
+
+void bigSub(bigFixed *result, bigFixed const *a, bigFixed const *b) {
+	uint64_t carry = 1;
+	for (unsigned int i = 0; i < result->limbs; i++) {
+		uint64_t sum = (uint64_t) a->digit[i] + (uint32_t) ~b->digit[i] + carry;
+		result->digit[i] = (uint32_t) sum;
+		carry = sum >> 32;
+	}
+}
+
+// Schoolbook product of the magnitudes, shifted back by the fraction limbs
+void bigMul(bigFixed *result, bigFixed const *a, bigFixed const *b, uint32_t *scratch) {
+	unsigned int const limbs = result->limbs;
+	uint32_t *x = scratch;
+	uint32_t *y = scratch + limbs;
+	uint32_t *product = scratch + 2 * limbs;
+	int const sign = negative(a->digit, limbs) ^ negative(b->digit, limbs);
+	memcpy(x, a->digit, limbs * sizeof(uint32_t));
+	memcpy(y, b->digit, limbs * sizeof(uint32_t));
+	if (negative(x, limbs)) {
+		negate(x, limbs);
+	}
+	if (negative(y, limbs)) {
+		negate(y, limbs);
+	}
+
+	memset(product, 0, 2 * limbs * sizeof(uint32_t));
+	for (unsigned int i = 0; i < limbs; i++) {
+		if (x[i] == 0) {
+			continue;
+		}
+		uint64_t carry = 0;
+		for (unsigned int j = 0; j < limbs; j++) {
+			uint64_t sum = (uint64_t) x[i] * y[j] + product[i + j] + carry;
+			product[i + j] = (uint32_t) sum;
+			carry = sum >> 32;
+		}
+		product[i + limbs] = (uint32_t) carry;
+	}
+
+	memcpy(result->digit, &product[limbs - 1], limbs * sizeof(uint32_t));
+	if (sign) {
+		negate(result->digit, limbs);
+	}
+}
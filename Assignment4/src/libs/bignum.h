@@ -0,0 +1,34 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdint.h>
+
+// Signed fixed-point numbers of arbitrary precision
+//
+// A number of n limbs is a two's complement integer of n 32-bit limbs,
+// least significant first, divided by 2^(32 * (n - 1)). The most
+// significant limb is the integer part, so numbers up to ±2^31 can be held
+// with 32 * (n - 1) fraction bits. All operands of an operation have the
+// same number of limbs, and the result may be one of them. Multiplications
+// truncate the bits below the last limb.
+
+typedef struct {
+	unsigned int limbs;
+	uint32_t *digit;
+} bigFixed;
+
+// Limbs holding a number near 1 with bits binary digits after the point
+unsigned int bigLimbsFor(unsigned int bits);
+
+bigFixed *newBigFixed(unsigned int limbs);
+void freeBigFixed(bigFixed *a);
+void bigCopy(bigFixed *to, bigFixed const *from);
+int bigFromString(bigFixed *to, char const *string);
+void bigFromDouble(bigFixed *to, double value);
+double bigToDouble(bigFixed const *a);
+void bigAdd(bigFixed *result, bigFixed const *a, bigFixed const *b);
+void bigSub(bigFixed *result, bigFixed const *a, bigFixed const *b);
+// scratch holds 4 * limbs limbs
+void bigMul(bigFixed *result, bigFixed const *a, bigFixed const *b, uint32_t *scratch);
+
+#endif // BIGNUM_H
@@ -0,0 +1,270 @@
+#include "escape.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Main cardioid: q (q + x - 1/4) <= y² / 4 with q = (x - 1/4)² + y²
+// Period-2 bulb: (x + 1)² + y² <= 1/16
+static int insideInterior(double cr, double ci) {
+	double ii = ci * ci;
+	double xq = cr - 0.25;
+	double q = xq * xq + ii;
+	double xb = cr + 1.0;
+	return q * (q + xq) <= 0.25 * ii || xb * xb + ii <= 0.0625;
+}
+
+unsigned long long escapeRowScalar(unsigned long long *dwell, double const *real, double imag,
+		unsigned int count, unsigned int maxDwell, unsigned int shortcuts) {
+	unsigned long long saved = 0;
+	for (unsigned int x = 0; x < count; x++) {
+		if ((shortcuts & ESCAPE_INTERIOR) && insideInterior(real[x], imag)) {
+			dwell[x] = maxDwell;
+			saved += maxDwell;
+			continue;
+		}
+
+		double zr = real[x];
+		double zi = imag;
+		double sr = zr;
+		double si = zi;
+		unsigned int power = 1;
+		unsigned int lambda = 0;
+		unsigned long long n = 0;
+
+		// Exit condition: dwell is maxDwell or |z|² >= 16
+		while (n < maxDwell) {
+			double rr = zr * zr;
+			double ii = zi * zi;
+			if (!(rr + ii < 16.0)) {
+				break;
+			}
+			double ri = zr * zi;
+			zi = ri + ri + imag;
+			zr = rr - ii + real[x];
+			n++;
+
+			if (shortcuts & ESCAPE_PERIODIC) {
+				if (zr == sr && zi == si) {
+					saved += maxDwell - n;
+					n = maxDwell;
+					break;
+				}
+				if (++lambda == power) {
+					sr = zr;
+					si = zi;
+					power *= 2;
+					lambda = 0;
+				}
+			}
+		}
+		dwell[x] = n;
+	}
+	return saved;
+}
+
+#if defined(__AVX512F__)
+
+char const *const escapeVectorName = "AVX-512";
+
+// One register of 8 pixels, the mask holds the lanes still iterating
+static unsigned long long escapeLanes(unsigned long long *dwell, double const *real, double imag,
+		unsigned int maxDwell, unsigned int shortcuts) {
+	__m512d const cr = _mm512_loadu_pd(real);
+	__m512d const ci = _mm512_set1_pd(imag);
+	__m512d const bailout = _mm512_set1_pd(16.0);
+	__m512i const one = _mm512_set1_epi64(1);
+	__m512i const most = _mm512_set1_epi64(maxDwell);
+	__m512d zr = cr;
+	__m512d zi = ci;
+	__m512d sr = zr;
+	__m512d si = zi;
+	__m512i n = _mm512_setzero_si512();
+	__mmask8 active = 0xff;
+	unsigned long long saved = 0;
+
+	if (shortcuts & ESCAPE_INTERIOR) {
+		__m512d ii = _mm512_mul_pd(ci, ci);
+		__m512d xq = _mm512_sub_pd(cr, _mm512_set1_pd(0.25));
+		__m512d q = _mm512_add_pd(_mm512_mul_pd(xq, xq), ii);
+		__m512d xb = _mm512_add_pd(cr, _mm512_set1_pd(1.0));
+		__mmask8 interior = _mm512_cmp_pd_mask(
+				_mm512_mul_pd(q, _mm512_add_pd(q, xq)), _mm512_mul_pd(_mm512_set1_pd(0.25), ii), _CMP_LE_OQ) |
+			_mm512_cmp_pd_mask(
+				_mm512_add_pd(_mm512_mul_pd(xb, xb), ii), _mm512_set1_pd(0.0625), _CMP_LE_OQ);
+		n = _mm512_mask_mov_epi64(n, interior, most);
+		saved += (unsigned long long)__builtin_popcount(interior) * maxDwell;
+		active &= ~interior;
+	}
+
+	unsigned int power = 1;
+	unsigned int lambda = 0;
+	for (unsigned int i = 0; i < maxDwell; i++) {
+		__m512d rr = _mm512_mul_pd(zr, zr);
+		__m512d ii = _mm512_mul_pd(zi, zi);
+		active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(rr, ii), bailout, _CMP_LT_OQ);
+		if (active == 0) {
+			break;
+		}
+		n = _mm512_mask_add_epi64(n, active, n, one);
+		__m512d ri = _mm512_mul_pd(zr, zi);
+		zi = _mm512_add_pd(_mm512_add_pd(ri, ri), ci);
+		zr = _mm512_add_pd(_mm512_sub_pd(rr, ii), cr);
+
+		// All lanes start together, so they move the saved value together
+		if (shortcuts & ESCAPE_PERIODIC) {
+			__mmask8 cycle = _mm512_mask_cmp_pd_mask(active, zr, sr, _CMP_EQ_OQ);
+			cycle = _mm512_mask_cmp_pd_mask(cycle, zi, si, _CMP_EQ_OQ);
+			if (cycle != 0) {
+				saved += (unsigned long long)__builtin_popcount(cycle) * maxDwell -
+					_mm512_mask_reduce_add_epi64(cycle, n);
+				n = _mm512_mask_mov_epi64(n, cycle, most);
+				active &= ~cycle;
+			}
+			if (++lambda == power) {
+				sr = zr;
+				si = zi;
+				power *= 2;
+				lambda = 0;
+			}
+		}
+	}
+	_mm512_storeu_si512((void *)dwell, n);
+	return saved;
+}
+
+#elif defined(__AVX2__)
+
+char const *const escapeVectorName = "AVX2";
+
+// Lanes of the masks are all ones where true
+static __m256d interiorMask(__m256d cr, __m256d ci) {
+	__m256d ii = _mm256_mul_pd(ci, ci);
+	__m256d xq = _mm256_sub_pd(cr, _mm256_set1_pd(0.25));
+	__m256d q = _mm256_add_pd(_mm256_mul_pd(xq, xq), ii);
+	__m256d xb = _mm256_add_pd(cr, _mm256_set1_pd(1.0));
+	return _mm256_or_pd(
+			_mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)), _mm256_mul_pd(_mm256_set1_pd(0.25), ii), _CMP_LE_OQ),
+			_mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(xb, xb), ii), _mm256_set1_pd(0.0625), _CMP_LE_OQ));
+}
+
+// Sets the dwell of the lanes in mask to maxDwell and returns the
+// iterations that skips
+static unsigned long long finishLanes(__m256i *n, __m256d mask, unsigned int maxDwell) {
+	unsigned long long counts[4];
+	unsigned long long saved = 0;
+	int const lanes = _mm256_movemask_pd(mask);
+	_mm256_storeu_si256((__m256i *)counts, *n);
+	for (int l = 0; l < 4; l++) {
+		if (lanes & (1 << l)) {
+			saved += maxDwell - counts[l];
+		}
+	}
+	*n = _mm256_castpd_si256(_mm256_blendv_pd(
+			_mm256_castsi256_pd(*n), _mm256_castsi256_pd(_mm256_set1_epi64x(maxDwell)), mask));
+	return saved;
+}
+
+// Two registers of 4 pixels, iterated together to hide the latency of the
+// multiplications
+static unsigned long long escapeLanes(unsigned long long *dwell, double const *real, double imag,
+		unsigned int maxDwell, unsigned int shortcuts) {
+	__m256d const cr0 = _mm256_loadu_pd(real);
+	__m256d const cr1 = _mm256_loadu_pd(real + 4);
+	__m256d const ci = _mm256_set1_pd(imag);
+	__m256d const bailout = _mm256_set1_pd(16.0);
+	__m256d zr0 = cr0;
+	__m256d zr1 = cr1;
+	__m256d zi0 = ci;
+	__m256d zi1 = ci;
+	__m256d sr0 = zr0;
+	__m256d sr1 = zr1;
+	__m256d si0 = zi0;
+	__m256d si1 = zi1;
+	__m256i n0 = _mm256_setzero_si256();
+	__m256i n1 = _mm256_setzero_si256();
+	__m256d active0 = _mm256_cmp_pd(ci, ci, _CMP_EQ_OQ);
+	__m256d active1 = active0;
+	unsigned long long saved = 0;
+
+	if (shortcuts & ESCAPE_INTERIOR) {
+		__m256d interior0 = interiorMask(cr0, ci);
+		__m256d interior1 = interiorMask(cr1, ci);
+		saved += finishLanes(&n0, interior0, maxDwell);
+		saved += finishLanes(&n1, interior1, maxDwell);
+		active0 = _mm256_andnot_pd(interior0, active0);
+		active1 = _mm256_andnot_pd(interior1, active1);
+	}
+
+	unsigned int power = 1;
+	unsigned int lambda = 0;
+	for (unsigned int i = 0; i < maxDwell; i++) {
+		__m256d rr0 = _mm256_mul_pd(zr0, zr0);
+		__m256d rr1 = _mm256_mul_pd(zr1, zr1);
+		__m256d ii0 = _mm256_mul_pd(zi0, zi0);
+		__m256d ii1 = _mm256_mul_pd(zi1, zi1);
+		active0 = _mm256_and_pd(active0, _mm256_cmp_pd(_mm256_add_pd(rr0, ii0), bailout, _CMP_LT_OQ));
+		active1 = _mm256_and_pd(active1, _mm256_cmp_pd(_mm256_add_pd(rr1, ii1), bailout, _CMP_LT_OQ));
+		if (_mm256_movemask_pd(_mm256_or_pd(active0, active1)) == 0) {
+			break;
+		}
+		// All ones is -1
+		n0 = _mm256_sub_epi64(n0, _mm256_castpd_si256(active0));
+		n1 = _mm256_sub_epi64(n1, _mm256_castpd_si256(active1));
+		__m256d ri0 = _mm256_mul_pd(zr0, zi0);
+		__m256d ri1 = _mm256_mul_pd(zr1, zi1);
+		zi0 = _mm256_add_pd(_mm256_add_pd(ri0, ri0), ci);
+		zi1 = _mm256_add_pd(_mm256_add_pd(ri1, ri1), ci);
+		zr0 = _mm256_add_pd(_mm256_sub_pd(rr0, ii0), cr0);
+		zr1 = _mm256_add_pd(_mm256_sub_pd(rr1, ii1), cr1);
+
+		// All lanes start together, so they move the saved value together
+		if (shortcuts & ESCAPE_PERIODIC) {
+			__m256d cycle0 = _mm256_and_pd(active0, _mm256_and_pd(
+					_mm256_cmp_pd(zr0, sr0, _CMP_EQ_OQ), _mm256_cmp_pd(zi0, si0, _CMP_EQ_OQ)));
+			__m256d cycle1 = _mm256_and_pd(active1, _mm256_and_pd(
+					_mm256_cmp_pd(zr1, sr1, _CMP_EQ_OQ), _mm256_cmp_pd(zi1, si1, _CMP_EQ_OQ)));
+			if (_mm256_movemask_pd(_mm256_or_pd(cycle0, cycle1)) != 0) {
+				saved += finishLanes(&n0, cycle0, maxDwell);
+				saved += finishLanes(&n1, cycle1, maxDwell);
+				active0 = _mm256_andnot_pd(cycle0, active0);
+				active1 = _mm256_andnot_pd(cycle1, active1);
+			}
+			if (++lambda == power) {
+				sr0 = zr0;
+				sr1 = zr1;
+				si0 = zi0;
+				si1 = zi1;
+				power *= 2;
+				lambda = 0;
+			}
+		}
+	}
+	_mm256_storeu_si256((__m256i *)dwell, n0);
+	_mm256_storeu_si256((__m256i *)(dwell + 4), n1);
+	return saved;
+}
+
+#else
+
+char const *const escapeVectorName = "scalar";
+
+static unsigned long long escapeLanes(unsigned long long *dwell, double const *real, double imag,
+		unsigned int maxDwell, unsigned int shortcuts) {
+	return escapeRowScalar(dwell, real, imag, ESCAPE_LANES, maxDwell, shortcuts);
+}
+
+#endif
+
+unsigned long long escapeRowVector(unsigned long long *dwell, double const *real, double imag,
+		unsigned int count, unsigned int maxDwell, unsigned int shortcuts) {
+	unsigned long long saved = 0;
+	unsigned int x = 0;
+	for (; x + ESCAPE_LANES <= count; x += ESCAPE_LANES) {
+		saved += escapeLanes(&dwell[x], &real[x], imag, maxDwell, shortcuts);
+	}
+
+	// The scalar kernel computes the same dwells for the rest of the row
+	saved += escapeRowScalar(&dwell[x], &real[x], imag, count - x, maxDwell, shortcuts);
+	return saved;
+}
@@ -0,0 +1,39 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+// Escape-time kernels for one row of the dwell buffer
+//
+// Pixel x of the row starts at real[x] + imag * i and iterates z = z² + c
+// until |z| reaches the bailout of 4 or maxDwell iterations are done. Both
+// kernels test the squared magnitude against 16 and do the same operations
+// in the same order, so their dwells are identical.
+//
+// Two shortcuts skip points that never escape. ESCAPE_INTERIOR tests the
+// main cardioid and the period-2 bulb analytically before iterating.
+// ESCAPE_PERIODIC compares z with a saved value every iteration, Brent
+// style: the saved value moves up to z after 1, 2, 4, 8, ... iterations, so
+// once the orbit settles into a cycle z meets it again within two of its
+// periods. Only exact repeats count, which can never escape, so the dwell
+// of a periodic point is maxDwell as if it had been iterated. Both return
+// the iterations they skipped.
+//
+// The vector kernel iterates ESCAPE_LANES pixels at once in AVX-512 or AVX2
+// registers, whichever the build targets (-march), with a mask of the lanes
+// still iterating. The pixels after the last whole register of the row
+// go through the scalar kernel.
+
+#define ESCAPE_LANES 8
+
+// Shortcuts of the kernels, or-ed together
+#define ESCAPE_INTERIOR 1
+#define ESCAPE_PERIODIC 2
+
+// Name of the instruction set the vector kernel was built for
+extern char const *const escapeVectorName;
+
+unsigned long long escapeRowScalar(unsigned long long *dwell, double const *real, double imag,
+		unsigned int count, unsigned int maxDwell, unsigned int shortcuts);
+unsigned long long escapeRowVector(unsigned long long *dwell, double const *real, double imag,
+		unsigned int count, unsigned int maxDwell, unsigned int shortcuts);
+
+#endif // ESCAPE_H
@@ -0,0 +1,64 @@
+#ifndef PERTURB_H
+#define PERTURB_H
+
+#include <complex.h>
+#include "bignum.h"
+
+// Deep zooms by perturbation
+//
+// The orbit Z of one reference point C is iterated in bigFixed precision and
+// kept in doubles. A pixel c = C + dc then only iterates its distance to it,
+// d = z - Z, which stays small enough for doubles however deep the zoom:
+//
+//     d(n+1) = (2 Z(n) + d(n)) d(n) + dc,    d(0) = dc
+//
+// z(0) = c like the escape-time kernels, so the dwells are the same.
+//
+// Series approximation skips the first iterations of every pixel. With
+// u = dc / radius, where radius bounds |dc| over the image, d(n) is
+// a(n) u + b(n) u² + c(n) u³ with
+//
+//     a(n+1) = 2 Z(n) a(n) + radius,  b(n+1) = 2 Z(n) b(n) + a(n)²,
+//     c(n+1) = 2 Z(n) c(n) + 2 a(n) b(n)
+//
+// from a(0) = radius, b(0) = c(0) = 0. The scaling by the radius keeps the
+// coefficients in range. They are iterated as long as the cubic and quartic
+// terms move no pixel by more than a fraction of its size and no pixel can
+// have escaped yet, and every pixel starts at that iteration.
+//
+// A pixel whose z gets much closer to 0 than Z (Pauldelbrot's criterion)
+// has lost the digits of d that matter and is glitched, as is a pixel still
+// iterating when the reference escaped. Glitched pixels are computed again
+// from another reference.
+
+// Squared ratio |z| / |Z| below which a pixel is glitched
+#define PERTURB_GLITCH 1e-6
+// Error of the series approximation in pixels that ends it
+#define PERTURB_SERIES_TOLERANCE 1e-5
+
+typedef struct {
+	unsigned int length; // iterations of the orbit stored
+	double complex *z; // Z(n)
+	double *glitch; // PERTURB_GLITCH |Z(n)|²
+	unsigned int skip; // iterations the series approximation skips
+	double radius;
+	double complex a, b, c; // series coefficients at skip
+} referenceOrbit;
+
+referenceOrbit *newReferenceOrbit(unsigned int maxDwell);
+void freeReferenceOrbit(referenceOrbit *orbit);
+
+// Fraction bits of a reference point for an image of the radius
+unsigned int perturbBits(double radius);
+
+// The orbit of re + im * i up to maxDwell iterations or its escape, then
+// the series approximation for offsets up to radius and pixels of that size
+int computeReferenceOrbit(referenceOrbit *orbit, bigFixed const *re, bigFixed const *im,
+		unsigned int maxDwell, double radius, double pixel);
+
+// Dwell of the pixel dc from the reference, glitched is set if it cannot be
+// trusted
+unsigned int perturbedDwell(referenceOrbit const *orbit, double complex dc, unsigned int maxDwell,
+		int *glitched);
+
+#endif // PERTURB_H
@@ -10,6 +10,8 @@
 #include <time.h>
 #include "libs/bitmap.h"
 #include "libs/utilities.h"
+#include "libs/escape.h"
+#include "libs/perturb.h"
 #include "main.h"
 
 // colourGradientSteps is defined in main.h
@@ -32,6 +34,19 @@ static unsigned int colourMapSize = 0;
 static unsigned int res = 2048;
 static unsigned int maxDwell = 512;
 
+// Escape-time kernel iterating one row of the dwell buffer, its shortcuts
+// and the iterations they saved
+static unsigned long long (*escapeRow)(unsigned long long *, double const *, double, unsigned int,
+		unsigned int, unsigned int) = escapeRowVector;
+static unsigned int shortcuts = 0;
+static unsigned long long iterationsSaved = 0;
+
+// Deep zooms iterate offsets from reference orbits, see perturb.h. Pixels
+// still glitched after the last reference keep the dwell they had.
+#define MAX_REFERENCES 64
+static unsigned int referencesUsed = 0;
+static unsigned long long glitchesLeft = 0;
+
 // Const log2
 static const double const_log2= 0.693147180559945309417232121458176568075500134360255254120;
 
@@ -42,28 +57,118 @@ void computeDwellBuffer(unsigned long long **buffer, double complex cmin, double
   double crealMin = creal(cmin);
   double cimagDiff = cimag(cmax - cmin);
   double cimagMin = cimag(cmin);
+
+  // Real part of every column
+  double *real = malloc(res * sizeof(double));
+  for (unsigned int x = 0; x < res; x++) {
+    real[x] = ((double) x / res) * crealDiff + crealMin;
+  }
   
-  // Loop over every pixel
+  // Loop over every row
 	for (unsigned int y = 0; y < res; y++) {
-    for (unsigned int x = 0; x < res; x++) {
-    
-      double real = ((double) x / res) * crealDiff + crealMin;
-      double imag = ((double) y / res) * cimagDiff + cimagMin;
-      double complex initValue = real + imag * I;
-      double complex z = real + imag * I;
-      unsigned int const dwellInc = 1;
-      unsigned long long dwell = 0;
-
-      // Exit condition: dwell is maxDwell or |z| >= 4
-      while(dwell < maxDwell && (cabs(z) < (4.0))) {
-        // z = z² + initValue
-        z = z * z + initValue;
-        dwell += dwellInc;
+    double imag = ((double) y / res) * cimagDiff + cimagMin;
+    iterationsSaved += escapeRow(buffer[y], real, imag, res, maxDwell, shortcuts);
+  }
+  free(real);
+}
+
+// Dwell buffer of the square of half width radius around the decimal
+// centerReal + centerImag * i
+int computeDeepDwellBuffer(unsigned long long **buffer, char const *centerReal,
+    char const *centerImag, double radius) {
+  int ret = 1;
+  unsigned int const limbs = bigLimbsFor(perturbBits(2 * radius / res));
+  bigFixed *centerRe = newBigFixed(limbs);
+  bigFixed *centerIm = newBigFixed(limbs);
+  bigFixed *re = newBigFixed(limbs);
+  bigFixed *im = newBigFixed(limbs);
+  bigFixed *offset = newBigFixed(limbs);
+  referenceOrbit *orbit = newReferenceOrbit(maxDwell);
+  unsigned char *glitched = malloc(res * res);
+  if (centerRe == NULL || centerIm == NULL || re == NULL || im == NULL || offset == NULL
+      || orbit == NULL || glitched == NULL) {
+    fprintf(stderr, "ERROR: could not allocate the reference orbit\n");
+    goto error_exit;
+  }
+  if (bigFromString(centerRe, centerReal) || bigFromString(centerIm, centerImag)) {
+    fprintf(stderr, "ERROR: invalid center %s %s\n", centerReal, centerImag);
+    goto error_exit;
+  }
+
+  // The first reference is the center, every following one the glitched
+  // pixel nearest to the centroid of all of them
+  memset(glitched, 1, res * res);
+  unsigned long long left = (unsigned long long) res * res;
+  double complex reference = 0;
+  for (referencesUsed = 0; left > 0 && referencesUsed < MAX_REFERENCES; referencesUsed++) {
+    if (referencesUsed > 0) {
+      double sumX = 0, sumY = 0;
+      for (unsigned int i = 0; i < res * res; i++) {
+        if (glitched[i]) {
+          sumX += i % res;
+          sumY += i / res;
+        }
+      }
+      double const centroidX = sumX / left;
+      double const centroidY = sumY / left;
+      double nearest = INFINITY;
+      for (unsigned int i = 0; i < res * res; i++) {
+        double dx = i % res - centroidX;
+        double dy = i / res - centroidY;
+        if (glitched[i] && dx * dx + dy * dy < nearest) {
+          nearest = dx * dx + dy * dy;
+          reference = ((2.0 * (i % res) / res - 1) + (2.0 * (i / res) / res - 1) * I) * radius;
+        }
       }
+    }
+    bigFromDouble(offset, creal(reference));
+    bigAdd(re, centerRe, offset);
+    bigFromDouble(offset, cimag(reference));
+    bigAdd(im, centerIm, offset);
+
+    // The series has to hold up to the farthest corner
+    double reach = 0;
+    for (int corner = 0; corner < 4; corner++) {
+      double complex c = ((corner & 1) ? radius : -radius) + ((corner & 2) ? radius : -radius) * I;
+      reach = fmax(reach, cabs(c - reference));
+    }
+    if (computeReferenceOrbit(orbit, re, im, maxDwell, reach, 2 * radius / res)) {
+      fprintf(stderr, "ERROR: could not compute the reference orbit\n");
+      goto error_exit;
+    }
 
-		  buffer[y][x] = dwell;
+    left = 0;
+    for (unsigned int y = 0; y < res; y++) {
+      double const imag = (2.0 * y / res - 1) * radius - cimag(reference);
+      for (unsigned int x = 0; x < res; x++) {
+        if (!glitched[y * res + x]) {
+          continue;
+        }
+        double const real = (2.0 * x / res - 1) * radius - creal(reference);
+        int glitch;
+        buffer[y][x] = perturbedDwell(orbit, real + imag * I, maxDwell, &glitch);
+        glitched[y * res + x] = glitch;
+        if (glitch) {
+          left++;
+        } else {
+          iterationsSaved += orbit->skip;
+        }
+      }
     }
   }
+  iterationsSaved += left * orbit->skip;
+  glitchesLeft = left;
+  ret = 0;
+
+error_exit:
+  freeBigFixed(centerRe);
+  freeBigFixed(centerIm);
+  freeBigFixed(re);
+  freeBigFixed(im);
+  freeBigFixed(offset);
+  freeReferenceOrbit(orbit);
+  free(glitched);
+  return ret;
 }
 
 void mapDwellBuffer(bmpImage *image, unsigned long long **buffer) {
@@ -105,6 +210,12 @@ void help(char const *exec, char const opt, char const *optarg) {
 	fprintf(out, "  -r [pixel]       Image resolution (default=2048)\n");
 	fprintf(out, "  -i [iterations]  Iterations or max dwell (default=512)\n");
 	fprintf(out, "  -c [colours]     Colour map iterations (default=1)\n");
+	fprintf(out, "  -k [kernel]      Escape-time kernel simd or scalar (default=simd)\n");
+	fprintf(out, "  -C               Skip the main cardioid and period-2 bulb\n");
+	fprintf(out, "  -P               Stop iterating periodic orbits (Brent)\n");
+	fprintf(out, "  -X [real]        Deep zoom center, real part in any precision (default=-0.5)\n");
+	fprintf(out, "  -Y [imag]        Deep zoom center, imaginary part in any precision (default=0)\n");
+	fprintf(out, "  -Z [radius]      Deep zoom half width of the image (default=1)\n");
 	fprintf(out, "%s [options]  <output-bmp>\n", exec);
 }
 
@@ -120,11 +231,15 @@ int main( int argc, char *argv[] )
 	double scale = 1; // scaling factor
 	unsigned int colourIterations = 1; //how many times the colour gradient is repeated
 	bool quiet = false; //output something or not
+	bool deep = false; // perturbation around centerReal + centerImag * i
+	char const *centerReal = "-0.5";
+	char const *centerImag = "0";
+	double radius = 1;
 
 	/* Parameter parsing... */
 	{
 		char c;
-		while((c = getopt(argc,argv,"x:y:s:r:i:c:qh"))!=-1) {
+		while((c = getopt(argc,argv,"x:y:s:r:i:c:k:CPX:Y:Z:qh"))!=-1) {
 			switch(c) {
 				case 'x':
 					x = clampDouble(atof(optarg),0.0,1.0);
@@ -145,6 +260,38 @@ int main( int argc, char *argv[] )
 				case 'c':
 					colourIterations = atoi(optarg);
 					break;
+				case 'k':
+					if (strcmp(optarg, "simd") == 0) {
+						escapeRow = escapeRowVector;
+					} else if (strcmp(optarg, "scalar") == 0) {
+						escapeRow = escapeRowScalar;
+					} else {
+						help(argv[0], c, optarg);
+						goto error_exit;
+					}
+					break;
+				case 'C':
+					shortcuts |= ESCAPE_INTERIOR;
+					break;
+				case 'P':
+					shortcuts |= ESCAPE_PERIODIC;
+					break;
+				case 'X':
+					centerReal = optarg;
+					deep = true;
+					break;
+				case 'Y':
+					centerImag = optarg;
+					deep = true;
+					break;
+				case 'Z':
+					radius = atof(optarg);
+					if (!(radius > 0)) {
+						help(argv[0], c, optarg);
+						goto error_exit;
+					}
+					deep = true;
+					break;
 				case 'q':
 					quiet = true;
 					break;
@@ -189,7 +336,12 @@ int main( int argc, char *argv[] )
 	double complex const cmax = (xmax - (0.5 * (1 - scale) * xlen)) + (ymax - (0.5 * (1 - scale) * ylen)) * I;
 
 	/* Output useful informations... */
-	if (!quiet) {
+	if (!quiet && deep) {
+		printf("Center:      %s, %s\n", centerReal, centerImag);
+		printf("Radius:      %g\n", radius);
+		printf("Iterations:  %u\n", maxDwell);
+		printf("Output:      %s\n", output);
+	} else if (!quiet) {
 		printf("Center:      [%f,%f]\n",x,y);
 		printf("Zoom:        %llu%%\n", (unsigned long long) (1/scale) * 100);
 		printf("Iterations:  %u\n", maxDwell);
@@ -224,7 +376,39 @@ int main( int argc, char *argv[] )
 	}
 
 	//Compute the dwell buffer
-	computeDwellBuffer(dwellBuffer, cmin, cmax);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (deep) {
+		if (computeDeepDwellBuffer(dwellBuffer, centerReal, centerImag, radius)) {
+			goto error_exit;
+		}
+	} else {
+		computeDwellBuffer(dwellBuffer, cmin, cmax);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	// Every unit of dwell is one iteration, iterated or skipped
+	if (!quiet) {
+		double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+		unsigned long long dwell = 0;
+		for (unsigned int i = 0; i < res * res; i++) {
+			dwell += rawDwellBuffer[i];
+		}
+		unsigned long long iterations = dwell - iterationsSaved;
+		if (deep) {
+			printf("Kernel:      perturbation\n");
+		} else {
+			printf("Kernel:      %s\n", escapeRow == escapeRowVector ? escapeVectorName : "scalar");
+		}
+		printf("Compute:     %.3f s, %.1f Miters/s\n", seconds, iterations / seconds * 1e-6);
+		if (deep) {
+			printf("References:  %u, %llu iterations skipped by the series, %llu glitched pixels left\n",
+					referencesUsed, iterationsSaved, glitchesLeft);
+		} else if (shortcuts != 0) {
+			printf("Shortcuts:   %llu of %llu iterations saved (%.1f%%)\n",
+					iterationsSaved, dwell, dwell > 0 ? 100.0 * iterationsSaved / dwell : 0.0);
+		}
+	}
 
 	//Map the dwell buffer to the bmpImage with fancy colors
 	mapDwellBuffer(image, dwellBuffer);
@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdlib.h>
+#include "perturb.h"
+
+referenceOrbit *newReferenceOrbit(unsigned int maxDwell) {
+	referenceOrbit *orbit = calloc(1, sizeof(referenceOrbit));
+	if (orbit == NULL) {
+		return NULL;
+	}
+	orbit->z = malloc((maxDwell + 1) * sizeof(double complex));
+	orbit->glitch = malloc((maxDwell + 1) * sizeof(double));
+	if (orbit->z == NULL || orbit->glitch == NULL) {
+		freeReferenceOrbit(orbit);
+		return NULL;
+	}
+	return orbit;
+}
+
+void freeReferenceOrbit(referenceOrbit *orbit) {
+	if (orbit == NULL) {
+		return;
+	}
+	free(orbit->z);
+	free(orbit->glitch);
+	free(orbit);
+}
+
+// The reference has to resolve the pixels, with the rest of a double to spare
+unsigned int perturbBits(double radius) {
+	double bits = radius < 1 ? -log2(radius) : 0;
+	return (unsigned int) ceil(bits) + 64;
+}
+
+static void approximateSeries(referenceOrbit *orbit, double radius, double pixel) {
+	double complex a = radius;
+	double complex b = 0;
+	double complex c = 0;
+	double complex e = 0;
+	unsigned int n = 0;
+
+	// |z(n)| <= |Z(n)| + |a| + |b| + |c| + |e| for every pixel while |u| <= 1.
+	// The quartic coefficient e is only iterated to tell how much the terms
+	// dropped would contribute. An error of d(n) moves the pixel by about
+	// radius / |a| times as much.
+	int valid = cabs(orbit->z[0]) + radius < 4;
+	while (valid && n + 1 < orbit->length) {
+		double complex twoZ = 2 * orbit->z[n];
+		double complex nextA = twoZ * a + radius;
+		double complex nextB = twoZ * b + a * a;
+		double complex nextC = twoZ * c + 2 * a * b;
+		double complex nextE = twoZ * e + b * b + 2 * a * c;
+		double dropped = cabs(nextC) + cabs(nextE);
+		if (dropped * radius > PERTURB_SERIES_TOLERANCE * pixel * cabs(nextA)
+				|| cabs(orbit->z[n + 1]) + cabs(nextA) + cabs(nextB) + dropped >= 4) {
+			break;
+		}
+		a = nextA;
+		b = nextB;
+		c = nextC;
+		e = nextE;
+		n++;
+	}
+	orbit->skip = n;
+	orbit->radius = radius;
+	orbit->a = a;
+	orbit->b = b;
+	orbit->c = c;
+}
+
+int computeReferenceOrbit(referenceOrbit *orbit, bigFixed const *re, bigFixed const *im,
+		unsigned int maxDwell, double radius, double pixel) {
+	int ret = 1;
+	unsigned int const limbs = re->limbs;
+	bigFixed *zr = newBigFixed(limbs);
+	bigFixed *zi = newBigFixed(limbs);
+	bigFixed *rr = newBigFixed(limbs);
+	bigFixed *ii = newBigFixed(limbs);
+	bigFixed *ri = newBigFixed(limbs);
+	uint32_t *scratch = malloc(4 * limbs * sizeof(uint32_t));
+	if (zr == NULL || zi == NULL || rr == NULL || ii == NULL || ri == NULL || scratch == NULL) {
+		goto error_exit;
+	}
+
+	// Same exit condition as the escape-time kernels, the last Z stored is
+	// the one that escaped
+	bigCopy(zr, re);
+	bigCopy(zi, im);
+	orbit->length = 0;
+	for (unsigned int n = 0; n < maxDwell; n++) {
+		double r = bigToDouble(zr);
+		double i = bigToDouble(zi);
+		double magnitude = r * r + i * i;
+		orbit->z[n] = r + i * I;
+		orbit->glitch[n] = PERTURB_GLITCH * magnitude;
+		orbit->length = n + 1;
+		if (!(magnitude < 16.0)) {
+			break;
+		}
+		bigMul(rr, zr, zr, scratch);
+		bigMul(ii, zi, zi, scratch);
+		bigMul(ri, zr, zi, scratch);
+		bigAdd(zi, ri, ri);
+		bigAdd(zi, zi, im);
+		bigSub(zr, rr, ii);
+		bigAdd(zr, zr, re);
+	}
+	approximateSeries(orbit, radius, pixel);
+	ret = 0;
+
+error_exit:
+	freeBigFixed(zr);
+	freeBigFixed(zi);
+	freeBigFixed(rr);
+	freeBigFixed(ii);
+	freeBigFixed(ri);
+	free(scratch);
+	return ret;
+}
+
+unsigned int perturbedDwell(referenceOrbit const *orbit, double complex dc, unsigned int maxDwell,
+		int *glitched) {
+	double complex u = dc / orbit->radius;
+	double complex d = ((orbit->c * u + orbit->b) * u + orbit->a) * u;
+	double const cr = creal(dc);
+	double const ci = cimag(dc);
+	double dr = creal(d);
+	double di = cimag(d);
+	unsigned int n = orbit->skip;
+
+	*glitched = 0;
+	while (n < maxDwell) {
+		if (n >= orbit->length) {
+			*glitched = 1;
+			break;
+		}
+		double const zr = creal(orbit->z[n]);
+		double const zi = cimag(orbit->z[n]);
+		double const r = zr + dr;
+		double const i = zi + di;
+		double const magnitude = r * r + i * i;
+		if (!(magnitude < 16.0)) {
+			break;
+		}
+		if (magnitude < orbit->glitch[n]) {
+			*glitched = 1;
+			break;
+		}
+		double const tr = zr + r;
+		double const ti = zi + i;
+		double const nextR = tr * dr - ti * di + cr;
+		di = tr * di + ti * dr + ci;
+		dr = nextR;
+		n++;
+	}
+	return n;
+}
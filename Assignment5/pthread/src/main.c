@@ -24,6 +24,9 @@
 
 #define DEBUG 0
 
+// References a deep zoom uses at most
+#define MAX_REFERENCES 64
+
 typedef struct job {
 	void (*callback)(dwellType *, unsigned int const, unsigned int const, unsigned int const);
 	dwellType *dwellBuffer;
@@ -174,6 +177,53 @@ void escapeTime( dwellType *buffer,
 		markBorder(buffer, dwellBorderCompute, atY, atX, blockSize);
 }
 
+// Center of a deep zoom and the reference at the offset reference from it
+bigFixed *centerRe = NULL;
+bigFixed *centerIm = NULL;
+bigFixed *referenceRe = NULL;
+bigFixed *referenceIm = NULL;
+bigFixed *offset = NULL;
+
+// The orbit of the reference, with the series approximation up to the
+// farthest corner of the image
+int computeReference(void) {
+	bigFromDouble(offset, creal(reference));
+	bigAdd(referenceRe, centerRe, offset);
+	bigFromDouble(offset, cimag(reference));
+	bigAdd(referenceIm, centerIm, offset);
+	double reach = 0;
+	for (int corner = 0; corner < 4; corner++) {
+		double complex const c = ((corner & 1) ? deepRadius : -deepRadius) + ((corner & 2) ? deepRadius : -deepRadius) * I;
+		reach = fmax(reach, cabs(c - reference));
+	}
+	return computeReferenceOrbit(orbit, referenceRe, referenceIm, maxDwell, reach, 2 * deepRadius / resolution);
+}
+
+// Offset of the glitched pixel nearest to the centroid of all of them, the
+// next reference of a deep zoom
+double complex nextReference(dwellType const *buffer, unsigned long long const glitched) {
+	double sumX = 0, sumY = 0;
+	for (unsigned int i = 0; i < resolution * resolution; i++) {
+		if (buffer[i] == dwellGlitched) {
+			sumX += i % resolution;
+			sumY += i / resolution;
+		}
+	}
+	double const centroidX = sumX / glitched;
+	double const centroidY = sumY / glitched;
+	double nearest = INFINITY;
+	double complex next = 0;
+	for (unsigned int i = 0; i < resolution * resolution; i++) {
+		double const dx = i % resolution - centroidX;
+		double const dy = i / resolution - centroidY;
+		if (buffer[i] == dwellGlitched && dx * dx + dy * dy < nearest) {
+			nearest = dx * dx + dy * dy;
+			next = ((2.0 * (i % resolution) / resolution - 1) + (2.0 * (i / resolution) / resolution - 1) * I) * deepRadius;
+		}
+	}
+	return next;
+}
+
 void help(char const *exec, char const opt, char const *optarg) {
 	FILE *out = stdout;
 	if (opt != 0) {
@@ -196,6 +246,11 @@ void help(char const *exec, char const opt, char const *optarg) {
 	fprintf(out, "  -p [threads]     number of concurrent threads (default=4)\n");
 	fprintf(out, "  -m mark Mariani-Silver borders\n");
 	fprintf(out, "  -t traditional computation (no Mariani-Silver)\n");
+	fprintf(out, "  -C skip the main cardioid and period-2 bulb\n");
+	fprintf(out, "  -P stop iterating periodic orbits (Brent)\n");
+	fprintf(out, "  -X [real]        Deep zoom center, real part in any precision (default=-0.5)\n");
+	fprintf(out, "  -Y [imag]        Deep zoom center, imaginary part in any precision (default=0)\n");
+	fprintf(out, "  -Z [radius]      Deep zoom half width of the image (default=1)\n");
 	fprintf(out, "%s [options]  <output-bmp>\n", exec);
 }
 
@@ -211,11 +266,15 @@ int main( int argc, char *argv[] )
 	bool quiet = false; //output something or not
 	bool useMarianiSilver = true;
 	unsigned int useThreads = 4;
+	char const *centerReal = "-0.5";
+	char const *centerImag = "0";
+	unsigned int referencesUsed = 0;
 
 	resolution = 1024;
 	maxDwell = 512;
 	blockDim = 16;
 	subdivisions = 4;
+	deepRadius = 1;
 
 
 	/* Dwell Buffer */
@@ -224,7 +283,7 @@ int main( int argc, char *argv[] )
 	/* Parameter parsing... */
 	{
 		char c;
-		while((c = getopt(argc,argv,"x:y:s:r:o:i:c:b:d:p:mthq"))!=-1) {
+		while((c = getopt(argc,argv,"x:y:s:r:o:i:c:b:d:p:mtCPX:Y:Z:hq"))!=-1) {
 			switch(c) {
 			case 'x':
 				x = clampDouble(atof(optarg),0.0,1.0);
@@ -259,6 +318,28 @@ int main( int argc, char *argv[] )
 			case 't':
 				useMarianiSilver = false;
 				break;
+			case 'C':
+				interiorShortcut = true;
+				break;
+			case 'P':
+				periodicShortcut = true;
+				break;
+			case 'X':
+				centerReal = optarg;
+				deepZoom = true;
+				break;
+			case 'Y':
+				centerImag = optarg;
+				deepZoom = true;
+				break;
+			case 'Z':
+				deepRadius = atof(optarg);
+				if (!(deepRadius > 0)) {
+					help(argv[0], c, optarg);
+					goto error_exit;
+				}
+				deepZoom = true;
+				break;
 			case 'p':
 				useThreads = atoi(optarg);
 				break;
@@ -307,7 +388,12 @@ int main( int argc, char *argv[] )
 	dc = cmax - cmin;
 
 	/* Output useful informations... */
-	if (!quiet) {
+	if (!quiet && deepZoom) {
+		printf("Center:      %s, %s\n", centerReal, centerImag);
+		printf("Radius:      %g\n", deepRadius);
+		printf("Iterations:  %u\n", maxDwell);
+		printf("Output:      %s\n", output);
+	} else if (!quiet) {
 		printf("Center:      [%f,%f]\n",x,y);
 		printf("Zoom:        %llu%%\n", (unsigned long long) (1/scale) * 100);
 		printf("Iterations:  %u\n", maxDwell);
@@ -330,6 +416,31 @@ int main( int argc, char *argv[] )
 		dwellBuffer[i] = dwellUncomputed;
 	}
 
+	if (deepZoom) {
+		unsigned int const limbs = bigLimbsFor(perturbBits(2 * deepRadius / resolution));
+		centerRe = newBigFixed(limbs);
+		centerIm = newBigFixed(limbs);
+		referenceRe = newBigFixed(limbs);
+		referenceIm = newBigFixed(limbs);
+		offset = newBigFixed(limbs);
+		orbit = newReferenceOrbit(maxDwell);
+		if (centerRe == NULL || centerIm == NULL || referenceRe == NULL || referenceIm == NULL
+				|| offset == NULL || orbit == NULL) {
+			fprintf(stderr, "ERROR: could not allocate the reference orbit!\n");
+			goto error_exit;
+		}
+		if (bigFromString(centerRe, centerReal) || bigFromString(centerIm, centerImag)) {
+			fprintf(stderr, "ERROR: invalid center %s %s\n", centerReal, centerImag);
+			goto error_exit;
+		}
+		if (computeReference()) {
+			fprintf(stderr, "ERROR: could not compute the reference orbit!\n");
+			goto error_exit;
+		}
+		referencesUsed = 1;
+		lastReference = (MAX_REFERENCES == 1);
+	}
+
 
 	if (useMarianiSilver) {
     if (DEBUG) printf("Using Mariani-Silver\n");
@@ -357,6 +468,46 @@ int main( int argc, char *argv[] )
   // Initalize workers and let them do their work
   initializeWorkers(useThreads);
 
+	// Every further reference of a deep zoom computes the pixels glitched
+	// so far again
+	while (deepZoom && !lastReference) {
+		unsigned long long glitched = 0;
+		for (unsigned int i = 0; i < resolution * resolution; i++) {
+			glitched += (dwellBuffer[i] == dwellGlitched);
+		}
+		if (glitched == 0) {
+			break;
+		}
+		reference = nextReference(dwellBuffer, glitched);
+		for (unsigned int i = 0; i < resolution * resolution; i++) {
+			if (dwellBuffer[i] == dwellGlitched) {
+				dwellBuffer[i] = dwellUncomputed;
+			}
+		}
+		if (computeReference()) {
+			fprintf(stderr, "ERROR: could not compute the reference orbit!\n");
+			goto error_exit;
+		}
+		referencesUsed++;
+		lastReference = (referencesUsed == MAX_REFERENCES);
+
+		unsigned int block = ceil((double) resolution / useThreads);
+		for (unsigned int t = 0; t < useThreads; t++) {
+			for (unsigned int x = 0; x < useThreads; x++) {
+				createJob(&computeBlock, dwellBuffer, t * block, x * block, block);
+			}
+		}
+		initializeWorkers(useThreads);
+	}
+	if (!quiet && deepZoom) {
+		printf("References:  %u, %llu iterations skipped by the series, %llu glitched pixels left\n",
+				referencesUsed, (unsigned long long) iterationsSaved, (unsigned long long) glitchesLeft);
+	}
+
+	if (!quiet && (interiorShortcut || periodicShortcut)) {
+		printf("Shortcuts:   %llu iterations saved\n", (unsigned long long) iterationsSaved);
+	}
+
 	// Map dwell buffer to image
 	for (unsigned int y = 0; y < resolution; y++) {
 		for (unsigned int x = 0; x < resolution; x++) {
@@ -378,6 +529,12 @@ exit_graceful:
 		freeBmpImage(image);
 	if(dwellBuffer)
 		free(dwellBuffer);
+	freeBigFixed(centerRe);
+	freeBigFixed(centerIm);
+	freeBigFixed(referenceRe);
+	freeBigFixed(referenceIm);
+	freeBigFixed(offset);
+	freeReferenceOrbit(orbit);
 	freeColourMap();
 	return ret;
 }
@@ -2,29 +2,95 @@
 #define __MANDELCOMPUTE_H_
 #include <complex.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "libs/perturb.h"
 
 typedef int dwellType;
 #define dwellUncomputed (dwellType) (-1)
 #define dwellBorderFill (dwellType) (-2)
 #define dwellBorderCompute (dwellType) (-3)
+#define dwellGlitched (dwellType) (-4)
 
 dwellType maxDwell;
 double complex dc;
 double complex cmin;
 unsigned int resolution;
 
+// Shortcuts for points that never escape, and the iterations they saved
+bool interiorShortcut;
+bool periodicShortcut;
+atomic_ullong iterationsSaved;
+
+// Deep zooms iterate the offset of every pixel from the orbit of a reference
+// at the offset reference from the center, see perturb.h. Glitched pixels
+// are marked to be computed again from another reference, except from the
+// last one, which leaves them the dwell they had.
+bool deepZoom;
+double deepRadius;
+double complex reference;
+referenceOrbit *orbit;
+bool lastReference;
+atomic_ullong glitchesLeft;
 
 dwellType pixelDwell(unsigned int const y, unsigned int const x) {
+	if (deepZoom) {
+		double complex const offset = ((2.0 * x / resolution - 1) + (2.0 * y / resolution - 1) * I) * deepRadius;
+		int glitched;
+		dwellType dwell = perturbedDwell(orbit, offset - reference, maxDwell, &glitched);
+		if (glitched) {
+			if (!lastReference) {
+				return dwellGlitched;
+			}
+			atomic_fetch_add_explicit(&glitchesLeft, 1, memory_order_relaxed);
+		}
+		atomic_fetch_add_explicit(&iterationsSaved, orbit->skip, memory_order_relaxed);
+		return dwell;
+	}
+
 	double complex const fdc = (((double) x / resolution) * creal(dc)) + (((double) y / resolution) * cimag(dc) * I);
 	double complex const c = cmin + fdc;
+
+	// Main cardioid: q (q + x - 1/4) <= y² / 4 with q = (x - 1/4)² + y²
+	// Period-2 bulb: (x + 1)² + y² <= 1/16
+	if (interiorShortcut) {
+		double const ii = cimag(c) * cimag(c);
+		double const xq = creal(c) - 0.25;
+		double const q = xq * xq + ii;
+		double const xb = creal(c) + 1.0;
+		if (q * (q + xq) <= 0.25 * ii || xb * xb + ii <= 0.0625) {
+			atomic_fetch_add_explicit(&iterationsSaved, maxDwell, memory_order_relaxed);
+			return maxDwell;
+		}
+	}
+
 	double complex z = c;
 	dwellType dwell = 0;
 
+	// Brent: z is compared with a value saved after 1, 2, 4, 8, ...
+	// iterations, so an orbit that settled into a cycle meets it again
+	double complex saved = z;
+	dwellType power = 1;
+	dwellType lambda = 0;
+
 	// Exit condition: dwell is maxDwell or |z| >= 4
 	while(dwell < maxDwell && sqrt(creal(z) * creal(z) + cimag(z) * cimag(z)) < 4) {
 		// z = z² + c
 		z = (z * z) + c;
 		dwell++;
+
+		// An exact repeat can never escape
+		if (periodicShortcut) {
+			if (z == saved) {
+				atomic_fetch_add_explicit(&iterationsSaved, maxDwell - dwell, memory_order_relaxed);
+				return maxDwell;
+			}
+			if (++lambda == power) {
+				saved = z;
+				power *= 2;
+				lambda = 0;
+			}
+		}
 	}
 
 	return dwell;
@@ -19,8 +19,14 @@ inline void gpuAssert(cudaError_t code, const char *file, int line, bool abort=t
    }
 }
 
-const int GPU = 1;
-const int CPU = 0;
+// Paths that run, set with make GPU=<0|1> CPU=<0|1>. With both, the GPU
+// result is compared with the CPU result pixel by pixel.
+#ifndef GPU
+#define GPU 1
+#endif
+#ifndef CPU
+#define CPU 0
+#endif
 
 // Convolutional Filter Examples, each with dimension 3,
 // gaussian filter with dimension 5
@@ -65,11 +71,122 @@ int const gaussianFilter[] = { 1,  4,  6,  4, 1,
 
 float const gaussianFilterFactor = (float) 1.0 / 256.0;
 
+// Filters by name. The sobel entry is the gradient magnitude of sobelY and
+// its transpose, which is not a convolution and has no weights.
+typedef struct {
+  char const *name;
+  int const *filter;
+  unsigned int dim;
+  float factor;
+} filterEntry;
+
+filterEntry const filters[] = {
+  {"sobelY",     sobelYFilter,     3, sobelYFilterFactor},
+  {"sobelX",     sobelXFilter,     3, sobelXFilterFactor},
+  {"laplacian1", laplacian1Filter, 3, laplacian1FilterFactor},
+  {"laplacian2", laplacian2Filter, 3, laplacian2FilterFactor},
+  {"laplacian3", laplacian3Filter, 3, laplacian3FilterFactor},
+  {"gaussian",   gaussianFilter,   5, gaussianFilterFactor},
+  {"sobel",      NULL,             3, 1.0f},
+  {NULL, NULL, 0, 0}
+};
 
-// Apply convolutional filter on image data
-void applyFilter(unsigned char **out, unsigned char **in, unsigned int width, unsigned int height, int *filter, unsigned int filterDim, float filterFactor) {
+// Filters applied one after the other in every iteration
+#define MAX_STAGES 8
+#define MAX_FILTER_DIM 5
+
+// Box filters of any radius are computed on running sums, so their cost per
+// pixel does not depend on the radius
+#define MAX_BOX_RADIUS 1024
+#define GAUSS_BOX_PASSES 3
+
+filterEntry const boxEntry = {"box", NULL, 0, 1.0f};
+
+typedef struct {
+  int count;
+  int radius;
+  filterEntry const *stages[MAX_STAGES];
+  // Radius of every box stage, 0 for all other stages
+  int box[MAX_STAGES];
+} filterPipeline;
+
+// Radii of box filters whose variances add up to about sigma^2, so that
+// applying them one after the other approximates a Gaussian
+void gaussBoxRadii(double sigma, int passes, int *radii) {
+  double variance = 12.0 * sigma * sigma;
+  int lower = 1;
+  while ((double)(lower + 2) * (lower + 2) <= variance / passes + 1) {
+    lower += 2;
+  }
+  double ideal = (passes * (lower * lower + 4.0 * lower + 3.0) - variance) / (4.0 * lower + 4.0);
+  int smaller = (int)(ideal + 0.5);
+  smaller = (smaller < 0) ? 0 : ((smaller > passes) ? passes : smaller);
+  for (int i = 0; i < passes; i++) {
+    radii[i] = (i < smaller) ? lower / 2 : lower / 2 + 1;
+  }
+}
+
+int appendStage(filterPipeline *pipeline, filterEntry const *entry, int box) {
+  if (pipeline->count == MAX_STAGES) {
+    return 1;
+  }
+  pipeline->stages[pipeline->count] = entry;
+  pipeline->box[pipeline->count] = box;
+  pipeline->radius += (box > 0) ? box : entry->dim / 2;
+  pipeline->count++;
+  return 0;
+}
+
+// Parse a comma separated list of filter names, box:<radius> and
+// gaussbox:<sigma>, returns 1 if a name is unknown
+int parsePipeline(filterPipeline *pipeline, char const *names) {
+  pipeline->count = 0;
+  pipeline->radius = 0;
+  while (*names != '\0') {
+    size_t length = strcspn(names, ",");
+    char *end;
+    if (strncmp(names, "box:", 4) == 0) {
+      long radius = strtol(names + 4, &end, 10);
+      if (end != names + length || end == names + 4 || radius < 1 || radius > MAX_BOX_RADIUS ||
+          appendStage(pipeline, &boxEntry, radius) != 0) {
+        return 1;
+      }
+    } else if (strncmp(names, "gaussbox:", 9) == 0) {
+      double sigma = strtod(names + 9, &end);
+      if (end != names + length || end == names + 9 || !(sigma > 0) || sigma > MAX_BOX_RADIUS / 2) {
+        return 1;
+      }
+      int radii[GAUSS_BOX_PASSES];
+      gaussBoxRadii(sigma, GAUSS_BOX_PASSES, radii);
+      for (int i = 0; i < GAUSS_BOX_PASSES; i++) {
+        if (radii[i] > 0 && appendStage(pipeline, &boxEntry, radii[i]) != 0) {
+          return 1;
+        }
+      }
+    } else {
+      filterEntry const *entry = NULL;
+      for (filterEntry const *e = filters; e->name != NULL; e++) {
+        if (strlen(e->name) == length && strncmp(e->name, names, length) == 0) {
+          entry = e;
+        }
+      }
+      if (entry == NULL || appendStage(pipeline, entry, 0) != 0) {
+        return 1;
+      }
+    }
+    names += length;
+    if (*names == ',') {
+      names++;
+    }
+  }
+  return (pipeline->count == 0);
+}
+
+
+// Apply convolutional filter on the rows y0 to y1 of image data
+void applyFilterRows(unsigned char **out, unsigned char **in, unsigned int width, unsigned int height, unsigned int y0, unsigned int y1, int const *filter, unsigned int filterDim, float filterFactor) {
   unsigned int const filterCenter = (filterDim / 2);
-  for (unsigned int y = 0; y < height; y++) {
+  for (unsigned int y = y0; y < y1; y++) {
     for (unsigned int x = 0; x < width; x++) {
       int aggregate = 0;
       for (unsigned int ky = 0; ky < filterDim; ky++) {
@@ -93,6 +210,148 @@ void applyFilter(unsigned char **out, unsigned char **in, unsigned int width, un
   }
 }
 
+// Apply convolutional filter on image data
+void applyFilter(unsigned char **out, unsigned char **in, unsigned int width, unsigned int height, int *filter, unsigned int filterDim, float filterFactor) {
+  applyFilterRows(out, in, width, height, 0, height, filter, filterDim, filterFactor);
+}
+
+// Square root of gx^2 + gy^2 rounded down, at most 255
+__host__ __device__ unsigned char gradientMagnitude(int gx, int gy) {
+  int square = gx * gx + gy * gy;
+  if (square >= 255 * 255) {
+    return 255;
+  }
+  int root = 0;
+  for (int bit = 128; bit > 0; bit >>= 1) {
+    if ((root + bit) * (root + bit) <= square) {
+      root += bit;
+    }
+  }
+  return root;
+}
+
+// Apply the sobel gradient magnitude on the rows y0 to y1 of image data
+void applyGradientRows(unsigned char **out, unsigned char **in, unsigned int width, unsigned int height, unsigned int y0, unsigned int y1) {
+  for (unsigned int y = y0; y < y1; y++) {
+    for (unsigned int x = 0; x < width; x++) {
+      int p[3][3];
+      for (int ky = 0; ky < 3; ky++) {
+        for (int kx = 0; kx < 3; kx++) {
+          int yy = y + ky - 1;
+          int xx = x + kx - 1;
+          p[ky][kx] = (xx >= 0 && xx < (int) width && yy >= 0 && yy < (int) height) ? in[yy][xx] : 0;
+        }
+      }
+      int gy = (p[2][0] + 2 * p[2][1] + p[2][2]) - (p[0][0] + 2 * p[0][1] + p[0][2]);
+      int gx = (p[0][2] + 2 * p[1][2] + p[2][2]) - (p[0][0] + 2 * p[1][0] + p[2][0]);
+      out[y][x] = gradientMagnitude(gx, gy);
+    }
+  }
+}
+
+// Mean of the (2 * radius + 1)^2 window of row y, rounded to the nearest
+// value. columns holds the sums of the window columns of row y - 1 and is
+// moved down by the row entering and the row leaving the window; the window
+// sum is moved right the same way. Rows have to be computed in order.
+void applyBoxRow(unsigned char **out, unsigned char **in, int *columns, unsigned int width, unsigned int height, unsigned int y, int radius) {
+  int const area = (2 * radius + 1) * (2 * radius + 1);
+  if (y == 0) {
+    memset(columns, 0, width * sizeof(int));
+    for (int yy = 0; yy < radius && yy < (int) height; yy++) {
+      for (unsigned int x = 0; x < width; x++) {
+        columns[x] += in[yy][x];
+      }
+    }
+  }
+  int enter = y + radius;
+  int leave = (int) y - radius - 1;
+  for (unsigned int x = 0; x < width; x++) {
+    columns[x] += ((enter < (int) height) ? in[enter][x] : 0) - ((leave >= 0) ? in[leave][x] : 0);
+  }
+  int sum = 0;
+  for (int x = 0; x < radius && x < (int) width; x++) {
+    sum += columns[x];
+  }
+  for (int x = 0; x < (int) width; x++) {
+    sum += ((x + radius < (int) width) ? columns[x + radius] : 0) - ((x - radius - 1 >= 0) ? columns[x - radius - 1] : 0);
+    out[y][x] = (sum + area / 2) / area;
+  }
+}
+
+// Line-buffered sweep over a pipeline: every stage but the last writes into
+// a ring holding only the rows the next stage still reads, and a row is
+// computed when the next stage first needs it.
+typedef struct {
+  filterPipeline const *pipeline;
+  unsigned int width;
+  unsigned int height;
+  unsigned char **in;
+  // Row pointers of every stage, the last stage writes the output
+  unsigned char **rows[MAX_STAGES];
+  // Next row every stage computes
+  unsigned int next[MAX_STAGES];
+  // Column sums of the box stages
+  int *columns[MAX_STAGES];
+} pipelineSweep;
+
+void advanceStage(pipelineSweep *sweep, int s, int last) {
+  filterEntry const *entry = sweep->pipeline->stages[s];
+  int const box = sweep->pipeline->box[s];
+  if (last >= (int) sweep->height) {
+    last = sweep->height - 1;
+  }
+  while ((int) sweep->next[s] <= last) {
+    unsigned int y = sweep->next[s];
+    if (s > 0) {
+      advanceStage(sweep, s - 1, y + ((box > 0) ? box : entry->dim / 2));
+    }
+    unsigned char **in = (s > 0) ? sweep->rows[s - 1] : sweep->in;
+    if (box > 0) {
+      applyBoxRow(sweep->rows[s], in, sweep->columns[s], sweep->width, sweep->height, y, box);
+    } else if (entry->filter == NULL) {
+      applyGradientRows(sweep->rows[s], in, sweep->width, sweep->height, y, y + 1);
+    } else {
+      applyFilterRows(sweep->rows[s], in, sweep->width, sweep->height, y, y + 1, entry->filter, entry->dim, entry->factor);
+    }
+    sweep->next[s] = y + 1;
+  }
+}
+
+void applyPipeline(unsigned char **out, unsigned char **in, unsigned int width, unsigned int height, filterPipeline const *pipeline) {
+  pipelineSweep sweep;
+  unsigned char *rings[MAX_STAGES];
+  sweep.pipeline = pipeline;
+  sweep.width = width;
+  sweep.height = height;
+  sweep.in = in;
+  for (int s = 0; s < pipeline->count; s++) {
+    sweep.columns[s] = (pipeline->box[s] > 0) ? (int *) malloc(width * sizeof(int)) : NULL;
+  }
+  for (int s = 0; s < pipeline->count - 1; s++) {
+    // A box stage still subtracts the row before its window
+    int radius = (pipeline->box[s + 1] > 0) ? pipeline->box[s + 1] : pipeline->stages[s + 1]->dim / 2;
+    unsigned int slots = 2 * radius + 2;
+    rings[s] = (unsigned char *) malloc(slots * width);
+    sweep.rows[s] = (unsigned char **) malloc(height * sizeof(unsigned char *));
+    for (unsigned int y = 0; y < height; y++) {
+      sweep.rows[s][y] = &rings[s][(y % slots) * width];
+    }
+    sweep.next[s] = 0;
+  }
+  sweep.rows[pipeline->count - 1] = out;
+  sweep.next[pipeline->count - 1] = 0;
+
+  advanceStage(&sweep, pipeline->count - 1, height - 1);
+
+  for (int s = 0; s < pipeline->count - 1; s++) {
+    free(rings[s]);
+    free(sweep.rows[s]);
+  }
+  for (int s = 0; s < pipeline->count; s++) {
+    free(sweep.columns[s]);
+  }
+}
+
 __global__ void applyFilterCuda(unsigned char *out, unsigned char *in, unsigned int width, unsigned int height, int *filter, unsigned int filterDim, float filterFactor) { 
     int iy = blockDim.y * blockIdx.y + threadIdx.y;
     int ix = blockDim.x * blockIdx.x + threadIdx.x;
@@ -122,6 +381,147 @@ __global__ void applyFilterCuda(unsigned char *out, unsigned char *in, unsigned
   }
 }
 
+// Weights of all stages of a pipeline one after the other
+__constant__ int cudaStageFilters[MAX_STAGES * MAX_FILTER_DIM * MAX_FILTER_DIM];
+
+typedef struct {
+  // Radius of a box stage run on running sums instead of the stages below
+  int box;
+  // First weight of the stages in cudaStageFilters
+  int offset;
+  int count;
+  int radius;
+  int dim[MAX_STAGES];
+  float factor[MAX_STAGES];
+  int gradient[MAX_STAGES];
+} cudaPipeline;
+
+// Every block loads its cells with a halo of the summed radii into shared
+// memory once. Each stage computes the block grown by the radii of the later
+// stages from the previous stage in shared memory, so only the input and
+// the result of the last stage go through global memory. Cells outside the
+// image are zero in every stage.
+__global__ void applyPipelineCuda(unsigned char *out, unsigned char *in, unsigned int width, unsigned int height, cudaPipeline pipeline) {
+    extern __shared__ unsigned char frames[];
+    int const radius = pipeline.radius;
+    int const pitch = blockDim.x + 2 * radius;
+    int const frameSize = pitch * (blockDim.y + 2 * radius);
+    int const x0 = (int) (blockDim.x * blockIdx.x) - radius;
+    int const y0 = (int) (blockDim.y * blockIdx.y) - radius;
+    int const thread = threadIdx.y * blockDim.x + threadIdx.x;
+    int const threads = blockDim.x * blockDim.y;
+    unsigned char *src = frames;
+    unsigned char *dst = frames + frameSize;
+
+    for (int i = thread; i < frameSize; i += threads) {
+        int x = x0 + i % pitch;
+        int y = y0 + i / pitch;
+        src[i] = (x >= 0 && x < (int) width && y >= 0 && y < (int) height) ? in[y * width + x] : 0;
+    }
+    __syncthreads();
+
+    int margin = radius;
+    int const *filter = &cudaStageFilters[pipeline.offset];
+    for (int s = 0; s < pipeline.count; s++) {
+        int const dim = pipeline.dim[s];
+        int const center = dim / 2;
+        margin -= center;
+        int const w = blockDim.x + 2 * margin;
+        int const h = blockDim.y + 2 * margin;
+        for (int i = thread; i < w * h; i += threads) {
+            int lx = radius - margin + i % w;
+            int ly = radius - margin + i / w;
+            int x = x0 + lx;
+            int y = y0 + ly;
+            unsigned char value = 0;
+            if (x >= 0 && x < (int) width && y >= 0 && y < (int) height) {
+                if (pipeline.gradient[s]) {
+                    unsigned char const *n = &src[(ly - 1) * pitch + lx];
+                    unsigned char const *c = &src[ly * pitch + lx];
+                    unsigned char const *so = &src[(ly + 1) * pitch + lx];
+                    int gy = (so[-1] + 2 * so[0] + so[1]) - (n[-1] + 2 * n[0] + n[1]);
+                    int gx = (n[1] + 2 * c[1] + so[1]) - (n[-1] + 2 * c[-1] + so[-1]);
+                    value = gradientMagnitude(gx, gy);
+                } else {
+                    int aggregate = 0;
+                    for (int ky = 0; ky < dim; ky++) {
+                        int nky = dim - 1 - ky;
+                        for (int kx = 0; kx < dim; kx++) {
+                            int nkx = dim - 1 - kx;
+                            aggregate += src[(ly + ky - center) * pitch + lx + kx - center] * filter[nky * dim + nkx];
+                        }
+                    }
+                    aggregate *= pipeline.factor[s];
+                    value = (aggregate > 0) ? ((aggregate > 255) ? 255 : aggregate) : 0;
+                }
+            }
+            dst[ly * pitch + lx] = value;
+        }
+        __syncthreads();
+        unsigned char *tmp = src;
+        src = dst;
+        dst = tmp;
+        filter += dim * dim;
+    }
+
+    int ix = blockDim.x * blockIdx.x + threadIdx.x;
+    int iy = blockDim.y * blockIdx.y + threadIdx.y;
+    if (ix < (int) width && iy < (int) height) {
+        out[iy * width + ix] = src[(threadIdx.y + radius) * pitch + threadIdx.x + radius];
+    }
+}
+
+#define BOX_ROW_THREADS 256
+
+// Prefix sums of the rows for a box filter, one block per row. The threads
+// scan consecutive cells of the row together, so that neighbouring threads
+// access neighbouring cells, and carry the total on to the next chunk.
+__global__ void boxRowsCuda(int *sums, unsigned char *in, unsigned int width, unsigned int height) {
+    __shared__ int scan[BOX_ROW_THREADS];
+    int const iy = blockIdx.x;
+    int const t = threadIdx.x;
+    int carry = 0;
+    for (int base = 0; base < (int) width; base += BOX_ROW_THREADS) {
+        int x = base + t;
+        scan[t] = (x < (int) width) ? in[iy * width + x] : 0;
+        __syncthreads();
+        for (int offset = 1; offset < BOX_ROW_THREADS; offset *= 2) {
+            int value = (t >= offset) ? scan[t - offset] : 0;
+            __syncthreads();
+            scan[t] += value;
+            __syncthreads();
+        }
+        if (x < (int) width) {
+            sums[iy * width + x] = carry + scan[t];
+        }
+        carry += scan[BOX_ROW_THREADS - 1];
+        __syncthreads();
+    }
+}
+
+// Horizontal window sum at x from the prefix sums of its row
+__device__ int boxWindow(int const *prefix, int x, unsigned int width, int radius) {
+    int const last = (x + radius < (int) width) ? x + radius : (int) width - 1;
+    return prefix[last] - ((x - radius - 1 >= 0) ? prefix[x - radius - 1] : 0);
+}
+
+// Vertical sums of the horizontal window sums, one thread per column, so
+// that neighbouring threads access neighbouring cells
+__global__ void boxColumnsCuda(unsigned char *out, int *sums, unsigned int width, unsigned int height, int radius) {
+    int ix = blockDim.x * blockIdx.x + threadIdx.x;
+    if (ix >= (int) width)
+        return;
+    int const area = (2 * radius + 1) * (2 * radius + 1);
+    int sum = 0;
+    for (int y = 0; y < radius && y < (int) height; y++) {
+        sum += boxWindow(&sums[y * width], ix, width, radius);
+    }
+    for (int y = 0; y < (int) height; y++) {
+        sum += ((y + radius < (int) height) ? boxWindow(&sums[(y + radius) * width], ix, width, radius) : 0) - ((y - radius - 1 >= 0) ? boxWindow(&sums[(y - radius - 1) * width], ix, width, radius) : 0);
+        out[y * width + ix] = (sum + area / 2) / area;
+    }
+}
+
 void help(char const *exec, char const opt, char const *optarg) {
     FILE *out = stdout;
     if (opt != 0) {
@@ -136,6 +536,14 @@ void help(char const *exec, char const opt, char const *optarg) {
     fprintf(out, "\n");
     fprintf(out, "Options:\n");
     fprintf(out, "  -i, --iterations <iterations>    number of iterations (1)\n");
+    fprintf(out, "  -k, --kernel <filter>[,<filter>] filter, or filters applied one after the\n");
+    fprintf(out, "                                   other in one sweep (laplacian1)\n");
+    fprintf(out, "                                  ");
+    for (filterEntry const *entry = filters; entry->name != NULL; entry++) {
+        fprintf(out, " %s", entry->name);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "                                   box:<radius> gaussbox:<sigma>\n");
 
     fprintf(out, "\n");
     fprintf(out, "Example: %s in.bmp out.bmp -i 10000\n", exec);
@@ -146,6 +554,8 @@ int main(int argc, char **argv) {
     Parameter parsing, don't change this!
    */
   unsigned int iterations = 1;
+  filterPipeline pipeline;
+  parsePipeline(&pipeline, "laplacian1");
   char *output = NULL;
   char *input = NULL;
   int ret = 0;
@@ -153,10 +563,11 @@ int main(int argc, char **argv) {
   static struct option const long_options[] =  {
       {"help",       no_argument,       0, 'h'},
       {"iterations", required_argument, 0, 'i'},
+      {"kernel",     required_argument, 0, 'k'},
       {0, 0, 0, 0}
   };
 
-  static char const * short_options = "hi:";
+  static char const * short_options = "hi:k:";
   {
     char *endptr;
     int c;
@@ -173,6 +584,12 @@ int main(int argc, char **argv) {
           return ERROR_EXIT;
         }
         break;
+      case 'k':
+        if (parsePipeline(&pipeline, optarg) != 0) {
+          help(argv[0], c, optarg);
+          return ERROR_EXIT;
+        }
+        break;
       default:
         abort();
       }
@@ -239,21 +656,84 @@ int main(int argc, char **argv) {
       cudaErrorCheck(cudaMemcpy(cudaRawInImage, imageChannel->rawdata, imageSize, cudaMemcpyHostToDevice));
   }
 
-  // Specify which filter to use
-  int *filter = (int *) laplacian1Filter;
-  int filterSize = sizeof(laplacian1Filter);
-  unsigned int filterDim = 3;
-  float filterFactor = laplacian1FilterFactor;
+  // Specify which filter to use. Several filters, or one without weights,
+  // run as a fused pipeline.
+  filterEntry const *first = pipeline.stages[0];
+  bool fused = pipeline.count > 1 || first->filter == NULL;
+  int *filter = (int *) first->filter;
+  int filterSize = first->dim * first->dim * sizeof(int);
+  unsigned int filterDim = first->dim;
+  float filterFactor = first->factor;
 
   // Copy the filter to device
   int *cudaFilter;
-  if (GPU) {
+  if (GPU && !fused) {
       cudaErrorCheck(cudaMalloc(&cudaFilter, filterSize));
       cudaErrorCheck(cudaMemcpy(cudaFilter, filter, filterSize, cudaMemcpyHostToDevice));
   }
 
+  // On the GPU the pipeline runs in segments: every box stage on its own
+  // with running sums, the stages between them fused in shared memory
+  cudaPipeline segments[MAX_STAGES];
+  int segmentCount = 0;
+  int *cudaBoxSums;
+  if (GPU && fused) {
+      int weights[MAX_STAGES * MAX_FILTER_DIM * MAX_FILTER_DIM];
+      int offset = 0;
+      bool boxes = false;
+      for (int s = 0; s < pipeline.count; s++) {
+          filterEntry const *entry = pipeline.stages[s];
+          cudaPipeline *segment = &segments[segmentCount];
+          if (pipeline.box[s] > 0 || s == 0 || segment[-1].box > 0) {
+              segment->box = pipeline.box[s];
+              segment->offset = offset;
+              segment->count = 0;
+              segment->radius = 0;
+              segmentCount++;
+          } else {
+              segment--;
+          }
+          if (pipeline.box[s] > 0) {
+              boxes = true;
+              continue;
+          }
+          segment->dim[segment->count] = entry->dim;
+          segment->factor[segment->count] = entry->factor;
+          segment->gradient[segment->count] = (entry->filter == NULL);
+          segment->radius += entry->dim / 2;
+          segment->count++;
+          for (unsigned int i = 0; i < entry->dim * entry->dim; i++) {
+              weights[offset++] = (entry->filter != NULL) ? entry->filter[i] : 0;
+          }
+      }
+      if (offset > 0) {
+          cudaErrorCheck(cudaMemcpyToSymbol(cudaStageFilters, weights, offset * sizeof(int)));
+      }
+      if (boxes) {
+          cudaErrorCheck(cudaMalloc(&cudaBoxSums, image->width * image->height * sizeof(int)));
+      }
+  }
+
   dim3 threadsPerBlock(8, 8);
   dim3 numBlocks(imageChannel->width / threadsPerBlock.x + 1, imageChannel->height / threadsPerBlock.y + 1);
+  int threadsPerLine = 64;
+
+  // A fused segment keeps two frames of its block and halo in shared memory
+  if (GPU && fused) {
+      cudaDeviceProp properties;
+      cudaErrorCheck(cudaGetDeviceProperties(&properties, 0));
+      for (int g = 0; g < segmentCount; g++) {
+          int const radius = segments[g].radius;
+          size_t sharedBytes = 2 * (threadsPerBlock.x + 2 * radius) * (threadsPerBlock.y + 2 * radius);
+          if (segments[g].box == 0 && sharedBytes > properties.sharedMemPerBlock) {
+              fprintf(stderr, "Fused stages of radius %d need %zu bytes of shared memory, more than the %zu of a block!\n",
+                      radius, sharedBytes, properties.sharedMemPerBlock);
+              freeBmpImage(image);
+              freeBmpImageChannel(imageChannel);
+              return ERROR_EXIT;
+          }
+      }
+  }
 
 
   //Here we do the actual computation!
@@ -263,7 +743,14 @@ int main(int argc, char **argv) {
     processImageChannel = newBmpImageChannel(imageChannel->width, imageChannel->height);
   }
   for (unsigned int i = 0; i < iterations; i ++) {
-    if (CPU) {
+    if (CPU && fused) {
+        applyPipeline(processImageChannel->data,
+                      imageChannel->data,
+                      imageChannel->width,
+                      imageChannel->height,
+                      &pipeline);
+        swapBmpImageChannels(imageChannel, processImageChannel);
+    } else if (CPU) {
         applyFilter(processImageChannel->data,
                     imageChannel->data,
                     imageChannel->width,
@@ -277,9 +764,32 @@ int main(int argc, char **argv) {
         swapBmpImageChannels(imageChannel, processImageChannel);
     }
 
-    if (GPU) {
+    if (GPU && fused) {
+        for (int g = 0; g < segmentCount; g++) {
+            cudaPipeline const *segment = &segments[g];
+            if (segment->box > 0) {
+                boxRowsCuda<<<imageChannel->height, BOX_ROW_THREADS>>>(cudaBoxSums, cudaRawInImage, imageChannel->width, imageChannel->height);
+                cudaErrorCheck(cudaGetLastError());
+                boxColumnsCuda<<<imageChannel->width / threadsPerLine + 1, threadsPerLine>>>(cudaRawOutImage, cudaBoxSums, imageChannel->width, imageChannel->height, segment->box);
+                cudaErrorCheck(cudaGetLastError());
+            } else {
+                size_t sharedBytes = 2 * (threadsPerBlock.x + 2 * segment->radius) * (threadsPerBlock.y + 2 * segment->radius);
+                applyPipelineCuda<<<numBlocks, threadsPerBlock, sharedBytes>>>(cudaRawOutImage, cudaRawInImage, imageChannel->width, imageChannel->height, *segment);
+                cudaErrorCheck(cudaGetLastError());
+            }
+            // The last swap follows below
+            if (g < segmentCount - 1) {
+                unsigned char *tmp = cudaRawInImage;
+                cudaRawInImage = cudaRawOutImage;
+                cudaRawOutImage = tmp;
+            }
+        }
+    } else if (GPU) {
         applyFilterCuda<<<numBlocks, threadsPerBlock>>>(cudaRawOutImage, cudaRawInImage, imageChannel->width, imageChannel->height, cudaFilter, filterDim, filterFactor);
+        cudaErrorCheck(cudaGetLastError());
+    }
 
+    if (GPU) {
         // Swap the data pointers for gpu
         unsigned char *tmp = cudaRawInImage;
         cudaRawInImage = cudaRawOutImage;
@@ -299,7 +809,15 @@ int main(int argc, char **argv) {
       // Free cuda memory
       cudaErrorCheck(cudaFree(cudaRawInImage));
       cudaErrorCheck(cudaFree(cudaRawOutImage));
-      cudaErrorCheck(cudaFree(cudaFilter)); 
+      if (!fused) {
+          cudaErrorCheck(cudaFree(cudaFilter));
+      }
+      for (int g = 0; g < segmentCount; g++) {
+          if (segments[g].box > 0) {
+              cudaErrorCheck(cudaFree(cudaBoxSums));
+              break;
+          }
+      }
   }
 
   if (GPU && CPU) {